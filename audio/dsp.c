@@ -0,0 +1,161 @@
+#include "dsp.h"
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Crossfade two interleaved stereo f32 buffers in place.
+ */
+void dsp_crossfade_stereo(float *dst, const float *src, size_t frames,
+                          float dst_start, float dst_end, float src_start,
+                          float src_end) {
+  if (frames == 0) {
+    return;
+  }
+  const float dst_step = (dst_end - dst_start) / (float)frames;
+  const float src_step = (src_end - src_start) / (float)frames;
+  size_t frame = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+  // two stereo frames per vector, both channels of a frame share a gain.
+  __m128 dst_gain = _mm_setr_ps(dst_start, dst_start, dst_start + dst_step,
+                                dst_start + dst_step);
+  __m128 src_gain = _mm_setr_ps(src_start, src_start, src_start + src_step,
+                                src_start + src_step);
+  const __m128 dst_inc = _mm_set1_ps(2.0f * dst_step);
+  const __m128 src_inc = _mm_set1_ps(2.0f * src_step);
+  for (; frame + 2 <= frames; frame += 2) {
+    __m128 in = _mm_loadu_ps(dst + frame * 2);
+    __m128 out = _mm_loadu_ps(src + frame * 2);
+    __m128 mix =
+        _mm_add_ps(_mm_mul_ps(in, dst_gain), _mm_mul_ps(out, src_gain));
+    _mm_storeu_ps(dst + frame * 2, mix);
+    dst_gain = _mm_add_ps(dst_gain, dst_inc);
+    src_gain = _mm_add_ps(src_gain, src_inc);
+  }
+#elif defined(__ARM_NEON)
+  const float dst_init[4] = {dst_start, dst_start, dst_start + dst_step,
+                             dst_start + dst_step};
+  const float src_init[4] = {src_start, src_start, src_start + src_step,
+                             src_start + src_step};
+  float32x4_t dst_gain = vld1q_f32(dst_init);
+  float32x4_t src_gain = vld1q_f32(src_init);
+  const float32x4_t dst_inc = vdupq_n_f32(2.0f * dst_step);
+  const float32x4_t src_inc = vdupq_n_f32(2.0f * src_step);
+  for (; frame + 2 <= frames; frame += 2) {
+    float32x4_t in = vld1q_f32(dst + frame * 2);
+    float32x4_t out = vld1q_f32(src + frame * 2);
+    float32x4_t mix = vmlaq_f32(vmulq_f32(in, dst_gain), out, src_gain);
+    vst1q_f32(dst + frame * 2, mix);
+    dst_gain = vaddq_f32(dst_gain, dst_inc);
+    src_gain = vaddq_f32(src_gain, src_inc);
+  }
+#endif
+  // scalar tail, or the whole buffer without SIMD.
+  for (; frame < frames; ++frame) {
+    const float dst_gain_f = dst_start + dst_step * (float)frame;
+    const float src_gain_f = src_start + src_step * (float)frame;
+    dst[frame * 2] = dst[frame * 2] * dst_gain_f + src[frame * 2] * src_gain_f;
+    dst[frame * 2 + 1] =
+        dst[frame * 2 + 1] * dst_gain_f + src[frame * 2 + 1] * src_gain_f;
+  }
+}
+
+/**
+ * Apply a gain ramp to interleaved stereo f32 samples in place.
+ */
+void dsp_gain_ramp_stereo(float *samples, size_t frames, float start,
+                          float end) {
+  if (frames == 0) {
+    return;
+  }
+  const float step = (end - start) / (float)frames;
+  size_t frame = 0;
+#if defined(__AVX2__)
+  // four stereo frames per vector, both channels of a frame share a gain.
+  __m256 gain = _mm256_setr_ps(start, start, start + step, start + step,
+                               start + 2.0f * step, start + 2.0f * step,
+                               start + 3.0f * step, start + 3.0f * step);
+  const __m256 inc = _mm256_set1_ps(4.0f * step);
+  for (; frame + 4 <= frames; frame += 4) {
+    __m256 in = _mm256_loadu_ps(samples + frame * 2);
+    _mm256_storeu_ps(samples + frame * 2, _mm256_mul_ps(in, gain));
+    gain = _mm256_add_ps(gain, inc);
+  }
+#elif defined(__SSE2__)
+  __m128 gain = _mm_setr_ps(start, start, start + step, start + step);
+  const __m128 inc = _mm_set1_ps(2.0f * step);
+  for (; frame + 2 <= frames; frame += 2) {
+    __m128 in = _mm_loadu_ps(samples + frame * 2);
+    _mm_storeu_ps(samples + frame * 2, _mm_mul_ps(in, gain));
+    gain = _mm_add_ps(gain, inc);
+  }
+#elif defined(__ARM_NEON)
+  const float init[4] = {start, start, start + step, start + step};
+  float32x4_t gain = vld1q_f32(init);
+  const float32x4_t inc = vdupq_n_f32(2.0f * step);
+  for (; frame + 2 <= frames; frame += 2) {
+    float32x4_t in = vld1q_f32(samples + frame * 2);
+    vst1q_f32(samples + frame * 2, vmulq_f32(in, gain));
+    gain = vaddq_f32(gain, inc);
+  }
+#endif
+  // scalar tail, or the whole buffer without SIMD.
+  for (; frame < frames; ++frame) {
+    const float gain_f = start + step * (float)frame;
+    samples[frame * 2] *= gain_f;
+    samples[frame * 2 + 1] *= gain_f;
+  }
+}
+
+/**
+ * Apply a constant gain to f32 samples in place.
+ */
+void dsp_gain(float *samples, size_t count, float gain) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256 gain_v = _mm256_set1_ps(gain);
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(samples + i,
+                     _mm256_mul_ps(_mm256_loadu_ps(samples + i), gain_v));
+  }
+#elif defined(__SSE2__)
+  const __m128 gain_v = _mm_set1_ps(gain);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), gain_v));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(samples + i, vmulq_n_f32(vld1q_f32(samples + i), gain));
+  }
+#endif
+  for (; i < count; ++i) {
+    samples[i] *= gain;
+  }
+}
+
+/**
+ * Convert decibels to a linear gain.
+ */
+float dsp_db_to_gain(float db) {
+  if (db <= DSP_SILENCE_DB) {
+    return 0.0f;
+  }
+  return powf(10.0f, db / 20.0f);
+}
+
+/**
+ * Convert a linear gain to decibels.
+ */
+float dsp_gain_to_db(float gain) {
+  if (gain <= 0.0f) {
+    return DSP_SILENCE_DB;
+  }
+  float db = 20.0f * log10f(gain);
+  return db < DSP_SILENCE_DB ? DSP_SILENCE_DB : db;
+}
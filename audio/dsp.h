@@ -0,0 +1,61 @@
+#ifndef PLAYER_NVIM_DSP_H
+#define PLAYER_NVIM_DSP_H
+
+#include <stddef.h>
+
+/**
+ * Crossfade two interleaved stereo f32 buffers in place.
+ * The gains ramp linearly per frame from their start to their end value
+ * across the buffer, so callers get a smooth curve by splitting a fade into
+ * short blocks.
+ *
+ * dst[i] = dst[i] * dst_gain + src[i] * src_gain
+ *
+ * @param[in,out] dst The incoming audio, receives the mix.
+ * @param[in] src The outgoing audio.
+ * @param[in] frames The number of stereo frames.
+ * @param[in] dst_start The incoming gain at the first frame.
+ * @param[in] dst_end The incoming gain after the last frame.
+ * @param[in] src_start The outgoing gain at the first frame.
+ * @param[in] src_end The outgoing gain after the last frame.
+ */
+void dsp_crossfade_stereo(float *dst, const float *src, size_t frames,
+                          float dst_start, float dst_end, float src_start,
+                          float src_end);
+
+/**
+ * Apply a gain ramp to interleaved stereo f32 samples in place.
+ * The gain ramps linearly per frame from start to end across the buffer.
+ *
+ * @param[in,out] samples The audio.
+ * @param[in] frames The number of stereo frames.
+ * @param[in] start The gain at the first frame.
+ * @param[in] end The gain after the last frame.
+ */
+void dsp_gain_ramp_stereo(float *samples, size_t frames, float start,
+                          float end);
+
+/**
+ * Apply a constant gain to f32 samples in place.
+ *
+ * @param[in,out] samples The audio.
+ * @param[in] count The number of samples.
+ * @param[in] gain The gain.
+ */
+void dsp_gain(float *samples, size_t count, float gain);
+
+/**
+ * Convert decibels to a linear gain.
+ */
+float dsp_db_to_gain(float db);
+
+/**
+ * Convert a linear gain to decibels.
+ * Silence is clamped to DSP_SILENCE_DB.
+ */
+float dsp_gain_to_db(float gain);
+
+/* Level treated as silence when converting gains to decibels. */
+#define DSP_SILENCE_DB -96.0f
+
+#endif
@@ -1,7 +1,133 @@
+/* pthread and clock_gettime are hidden by -std=c11 without this. */
+#define _POSIX_C_SOURCE 200809L
+/* syscall too, for the futex the decode thread sleeps on. */
+#define _DEFAULT_SOURCE
+
 #include "play.h"
+#include "dsp.h"
+#include "seek_cache.h"
 #define MINIAUDIO_IMPLEMENTATION 1
 #include "miniaudio.h"
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/statfs.h>
+#endif
+
+/* Length of the decoded PCM ring buffer in milliseconds. */
+#define RING_BUFFER_MS 500
+/* Max amount of frames the decode thread decodes in one pass. */
+#define DECODE_CHUNK_FRAMES 4096
+/* How long the decode thread sleeps when the ring buffer is full. */
+#define DECODE_WAIT_MS 20
+/* Fixed output format of the device, decoders convert to it. */
+#define OUTPUT_FORMAT ma_format_f32
+/* Fixed output channel count of the device. */
+#define OUTPUT_CHANNELS 2
+/* How long to wait for the callback to flush the ring buffer. */
+#define FLUSH_TIMEOUT_MS 500
+/* Seconds of audio between two MP3 seek points. */
+#define SEEK_POINT_INTERVAL_SEC 1
+/* Max amount of MP3 seek points per file. */
+#define SEEK_POINT_MAX 65536
+/* Voices in the pool: the current, the fading out and the next track. */
+#define VOICE_COUNT 3
+/* Longest allowed crossfade in milliseconds. */
+#define CROSSFADE_MAX_MS 12000
+/* Frames between two points of the crossfade curve, linear in between. */
+#define FADE_BLOCK_FRAMES 256
+/* Largest file that is memory mapped instead of read through stdio. */
+#define MMAP_MAX_SIZE ((size_t)1 << 31)
+/* Bytes ahead of the decoder that are prefetched from a memory mapped file. */
+#define MMAP_WINDOW_SIZE ((size_t)1 << 20)
+/* Default length of a volume change ramp in milliseconds. */
+#define VOLUME_RAMP_MS 30
+/* Longest allowed volume change ramp in milliseconds. */
+#define VOLUME_RAMP_MAX_MS 2000
+/* Range in decibels covered by the 0 - 1 volume curve. */
+#define VOLUME_RANGE_DB 40.0f
+/* Frames between two points of a dB volume ramp, linear in between. */
+#define GAIN_BLOCK_FRAMES 64
+
+/**
+ * Lifecycle state of the player.
+ */
+enum player_state_t {
+  /* Nothing is loaded. */
+  STATE_IDLE,
+  /* Audio is handed to the device. */
+  STATE_PLAYING,
+  /* Audio is loaded but the callback does not read it. */
+  STATE_PAUSED,
+  /* The decoder has ended, the callback plays what is left in the ring. */
+  STATE_DRAINING,
+  /* Everything was played. */
+  STATE_ENDED,
+};
+
+/**
+ * Kinds of requests posted to the decode thread.
+ */
+enum request_kind_t {
+  /* Play the file, replacing the current song. */
+  REQUEST_PLAY,
+  /* Play the file once the current song ends. */
+  REQUEST_ENQUEUE,
+  /* Seek the current song to the frame. */
+  REQUEST_SEEK,
+  /* Pause the current song. */
+  REQUEST_PAUSE,
+  /* Resume the current song. */
+  REQUEST_RESUME,
+  /* Unload the current song and stop the device. */
+  REQUEST_STOP,
+};
+
+/**
+ * A control request run by the decode thread.
+ */
+struct request_t {
+  /* The request posted before this one once taken, the newer one before. */
+  struct request_t *next;
+  /* One of request_kind_t. */
+  int kind;
+  /* The frame to seek to. */
+  uint64_t frame;
+  /* The file to play, null terminated. */
+  char file_name[];
+};
+
+/**
+ * A decoder slot in the voice pool.
+ */
+struct voice_t {
+  /* Decoder for reading the audio file. */
+  ma_decoder decoder;
+  /* MP3 seek table bound to the decoder, NULL if none. */
+  ma_dr_mp3_seek_point *seek_points;
+  /* Length of the audio in frames, 0 if unknown. */
+  ma_uint64 length;
+  /* Memory mapped audio file the decoder reads from, NULL if it uses stdio. */
+  void *mapping;
+  /* Size of the memory mapped audio file. */
+  size_t mapping_size;
+  /* End of the range that was already advised to be prefetched. */
+  size_t advised_end;
+  /* Bumped every time the voice is released. */
+  unsigned serial;
+  /* Flag for the voice holding an open decoder. */
+  bool in_use;
+};
 
 /**
  * Player structure
@@ -9,55 +135,1160 @@
 struct player_t {
   /* Playback callback for audio updates. */
   playback_cb cb;
-  /* playback device. */
+  /* Audio context, kept for the life of the player. */
+  ma_context context;
+  /* playback device, kept open for the life of the player. */
   ma_device device;
-  /* Decoder for reading the audio file. */
-  ma_decoder decoder;
+  /* Fixed pool of voices, so tracks can overlap without allocating. */
+  struct voice_t voices[VOICE_COUNT];
+  /* Index of the voice the decode thread is reading from. */
+  int current;
+  /* Index of the opened next voice, -1 if none. */
+  int next;
+  /* Index of the voice fading out, -1 if none or it ended before the fade. */
+  int fading;
+  /* Index of the voice being opened by the decode thread, -1 if none. */
+  int opening;
+  /* Position in frames inside the crossfade, running while below fade_len. */
+  ma_uint64 fade_pos;
+  /* Length in frames of the running crossfade. */
+  ma_uint64 fade_len;
+  /* Configured crossfade length in milliseconds, 0 for gapless. */
+  ma_uint32 crossfade_ms;
+  /* Scratch buffer for the fading out voice. */
+  float fade_buffer[DECODE_CHUNK_FRAMES * OUTPUT_CHANNELS];
   /* Device configuration. */
   ma_device_config config;
-  /* Is playing flag. */
-  bool is_playing;
-  /* Has ended flag. */
-  bool has_ended;
-  /* Configured flag. */
-  bool configured;
+  /* Decoded PCM frames, written by the decode thread, read by the callback. */
+  ma_pcm_rb ring;
+  /* Decode thread feeding the ring buffer. */
+  pthread_t decode_thread;
+  /* Lock guarding the decoder and decode flags. */
+  pthread_mutex_t decode_lock;
+  /* Bumped to wake up the decode thread, which sleeps on it as a futex. */
+  atomic_uint decode_wake;
+  /* Flag for the decode thread to read from the decoder. */
+  bool decoding;
+  /* Flag for the decode thread to exit. */
+  bool decode_quit;
+  /* File waiting to be opened as the next decoder. */
+  char *next_file;
+  /* Requests posted by the control calls, newest first. */
+  _Atomic(struct request_t *) requests;
+  /* Posted plays the decode thread has not started yet. */
+  atomic_uint pending_plays;
+  /* Bumped on every new play so stale background opens are dropped. */
+  unsigned generation;
+  /* Total frames written into the ring since the last play. */
+  ma_uint64 frames_written;
+  /* Flag for the decoder reaching the end of the audio. */
+  atomic_bool decode_ended;
+  /* Flag for the callback to drop everything in the ring buffer. */
+  atomic_bool flush_requested;
+  /* Total frames handed to the device since the last play. */
+  atomic_uint_fast64_t frames_played;
+  /* Bumped around every update of the position stamp, odd while writing. */
+  atomic_uint stamp_seq;
+  /* frames_played at the last period that handed audio to the device. */
+  atomic_uint_fast64_t stamp_frames;
+  /* Monotonic time in nanoseconds of the last position stamp. */
+  atomic_uint_fast64_t stamp_ns;
+  /* Frame heard when the device got audio again after a stall, the audible
+   * frame does not go back below it while the new audio is on its way. */
+  atomic_uint_fast64_t stamp_floor;
+  /* Flag for the callback having handed no audio since its last stamp, only
+   * touched by the callback. */
+  bool stalled;
+  /* Frames queued in the device between the callback and the speakers. */
+  ma_uint64 latency_frames;
+  /* Frame (in frames_played) where the audible track started. */
+  atomic_uint_fast64_t track_start;
+  /* Length in frames of the audible track. */
+  atomic_uint_fast64_t track_length;
+  /* Frame (in frames_played) where the next track starts, UINT64_MAX if none. */
+  atomic_uint_fast64_t next_track_start;
+  /* Length in frames of the next track. */
+  atomic_uint_fast64_t next_track_length;
+  /* Index thread building seek tables in the background. */
+  pthread_t index_thread;
+  /* Lock guarding the index job. */
+  pthread_mutex_t index_lock;
+  /* Condition to wake up the index thread. */
+  pthread_cond_t index_cond;
+  /* File waiting for a seek table to be built, NULL if none. */
+  char *index_file;
+  /* Voice the pending seek table is for. */
+  int index_slot;
+  /* Serial of the voice the pending seek table is for. */
+  unsigned index_serial;
+  /* Flag for the index thread to exit. */
+  bool index_quit;
+  /* Volume set by the user, between 0 - 1. */
+  _Atomic float volume;
+  /* Linear gain the gain stage ramps towards. */
+  _Atomic float gain_target;
+  /* Length of a volume change ramp in milliseconds. */
+  atomic_uint ramp_ms;
+  /* Curve of a volume change ramp. */
+  atomic_int ramp_law;
+  /* Linear gain applied by the callback, only touched by the callback. */
+  float gain;
+  /* Gain the running ramp started from, only touched by the callback. */
+  float ramp_from;
+  /* Gain the running ramp ends at, only touched by the callback. */
+  float ramp_to;
+  /* Curve of the running ramp, only touched by the callback. */
+  int ramp_curve;
+  /* Position in frames inside the running ramp. */
+  ma_uint32 ramp_pos;
+  /* Length in frames of the running ramp. */
+  ma_uint32 ramp_len;
+  /* Lifecycle state, one of player_state_t. */
+  atomic_int state;
 };
 
 /**
- * Free the device and decoder objects.
+ * Move the player from one state to another.
+ *
+ * @return True if the player was in the from state, false otherwise.
+ */
+static bool transition(struct player_t *p, int from, int to) {
+  return atomic_compare_exchange_strong_explicit(
+      &p->state, &from, to, memory_order_acq_rel, memory_order_acquire);
+}
+
+/**
+ * Get the lifecycle state of the player.
+ */
+static int load_state(struct player_t *p) {
+  return atomic_load_explicit(&p->state, memory_order_acquire);
+}
+
+/**
+ * Get the decoder the decode thread is currently reading from.
+ */
+static ma_decoder *current_decoder(struct player_t *p) {
+  return &p->voices[p->current].decoder;
+}
+
+/**
+ * Find a voice without an open decoder.
+ *
+ * @return The voice index, -1 if all voices are in use.
+ */
+static int free_voice(struct player_t *p) {
+  for (int i = 0; i < VOICE_COUNT; ++i) {
+    if (!p->voices[i].in_use) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Get the MP3 decoder behind the given decoder, NULL if it is not an MP3.
+ */
+static ma_dr_mp3 *decoder_mp3(ma_decoder *decoder) {
+  if (decoder->pBackendVTable != &g_ma_decoding_backend_vtable_mp3 ||
+      decoder->pBackend == NULL) {
+    return NULL;
+  }
+  return &((ma_mp3 *)decoder->pBackend)->dr;
+}
+
+/**
+ * Free a voice's decoder and the seek table bound to it.
+ */
+static void release_voice(struct player_t *p, int slot) {
+  struct voice_t *voice = &p->voices[slot];
+  if (voice->in_use) {
+    ma_decoder_uninit(&voice->decoder);
+  }
+  if (voice->mapping != NULL) {
+    munmap(voice->mapping, voice->mapping_size);
+    voice->mapping = NULL;
+    voice->mapping_size = 0;
+  }
+  free(voice->seek_points);
+  voice->seek_points = NULL;
+  voice->length = 0;
+  voice->serial++;
+  voice->in_use = false;
+}
+
+/**
+ * Check if the file lives on a filesystem where memory mapping is risky.
+ * Network and FUSE mounts can drop pages under us, which turns into a
+ * SIGBUS instead of a read error.
+ */
+static bool mmap_unsafe_fs(int fd) {
+#if defined(__linux__)
+  struct statfs fs;
+  if (fstatfs(fd, &fs) != 0) {
+    return true;
+  }
+  switch ((unsigned long)fs.f_type) {
+  case 0x6969UL:     // NFS
+  case 0x517BUL:     // SMB
+  case 0xFE534D42UL: // SMB2
+  case 0xFF534D42UL: // CIFS
+  case 0x65735546UL: // FUSE
+  case 0x01021997UL: // 9P
+  case 0x00C36400UL: // CEPH
+    return true;
+  default:
+    return false;
+  }
+#else
+  (void)fd;
+  return false;
+#endif
+}
+
+/**
+ * Memory map the given audio file.
+ *
+ * @param file_name The audio file.
+ * @param[out] size The size of the mapping.
+ * @return The mapping, NULL if the file should be read through stdio.
+ */
+static void *map_file(const char *file_name, size_t *size) {
+  int fd = open(file_name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  void *mapping = NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      (size_t)st.st_size > MMAP_MAX_SIZE || mmap_unsafe_fs(fd)) {
+    close(fd);
+    return NULL;
+  }
+  mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file referenced on its own.
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+  *size = (size_t)st.st_size;
+  posix_madvise(mapping, *size, POSIX_MADV_SEQUENTIAL);
+  return mapping;
+}
+
+/**
+ * Ask the kernel to prefetch the window of the mapping ahead of the decoder.
+ * Only issues the advice once the decoder moved into a new window.
+ */
+static void advise_window(struct voice_t *voice) {
+  if (voice->mapping == NULL) {
+    return;
+  }
+  size_t pos = voice->decoder.data.memory.currentReadPos;
+  if (pos + MMAP_WINDOW_SIZE / 2 < voice->advised_end ||
+      voice->advised_end >= voice->mapping_size) {
+    return;
+  }
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t start = pos & ~(page - 1);
+  size_t end = start + MMAP_WINDOW_SIZE;
+  if (end > voice->mapping_size) {
+    end = voice->mapping_size;
+  }
+  posix_madvise((ma_uint8 *)voice->mapping + start, end - start,
+                POSIX_MADV_WILLNEED);
+  voice->advised_end = end;
+}
+
+/**
+ * Open the decoder of a voice, converted to the device's format.
+ * Decodes straight from a memory mapping of the file when possible, so
+ * compressed formats read from the page cache instead of issuing small
+ * reads. Falls back to stdio for files that should not be mapped.
+ */
+static ma_result open_voice(struct player_t *p, struct voice_t *voice,
+                            const char *file_name) {
+  ma_decoder_config config = ma_decoder_config_init(
+      p->device.playback.format, p->device.playback.channels,
+      p->device.sampleRate);
+  size_t size = 0;
+  void *mapping = map_file(file_name, &size);
+  if (mapping != NULL) {
+    ma_result result =
+        ma_decoder_init_memory(mapping, size, &config, &voice->decoder);
+    if (result == MA_SUCCESS) {
+      voice->mapping = mapping;
+      voice->mapping_size = size;
+      voice->advised_end = 0;
+      advise_window(voice);
+      return MA_SUCCESS;
+    }
+    munmap(mapping, size);
+  }
+  return ma_decoder_init_file(file_name, &config, &voice->decoder);
+}
+
+/**
+ * Bind a seek table to the decoder in the given slot.
+ * Takes ownership of the seek points.
+ */
+static void bind_seek_table(struct player_t *p, int slot,
+                            ma_dr_mp3_seek_point *points, ma_uint32 count) {
+  ma_dr_mp3 *mp3 = decoder_mp3(&p->voices[slot].decoder);
+  if (mp3 == NULL || !ma_dr_mp3_bind_seek_table(mp3, count, points)) {
+    free(points);
+    return;
+  }
+  free(p->voices[slot].seek_points);
+  p->voices[slot].seek_points = points;
+}
+
+/**
+ * Attach a seek table to a freshly opened decoder.
+ * Uses the cached table when it exists, otherwise the index thread builds
+ * one in the background. Until then seeking falls back to miniaudio's own
+ * seeking.
+ *
+ * @param p The player structure.
+ * @param slot The voice. Must not be read by the decode thread yet.
+ * @param file_name The audio file of the decoder.
+ * @param[out] length The length of the audio in frames from the cache, left
+ *  untouched on a cache miss.
+ */
+static void attach_seek_table(struct player_t *p, int slot,
+                              const char *file_name, ma_uint64 *length) {
+  ma_dr_mp3 *mp3 = decoder_mp3(&p->voices[slot].decoder);
+  if (mp3 == NULL) {
+    // FLAC uses its own SEEKTABLE and WAV seeks directly.
+    return;
+  }
+  void *data = NULL;
+  size_t size = 0;
+  uint64_t total_frames = 0;
+  if (seek_cache_load(file_name, &data, &size, &total_frames)) {
+    if (size % sizeof(ma_dr_mp3_seek_point) == 0 && mp3->sampleRate > 0) {
+      bind_seek_table(p, slot, (ma_dr_mp3_seek_point *)data,
+                      (ma_uint32)(size / sizeof(ma_dr_mp3_seek_point)));
+      // the cached length is in the mp3's rate, convert to the output rate.
+      *length = ma_calculate_frame_count_after_resampling(
+          p->voices[slot].decoder.outputSampleRate, mp3->sampleRate,
+          total_frames);
+      return;
+    }
+    free(data);
+  }
+  char *copy = strdup(file_name);
+  if (copy == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&p->index_lock);
+  free(p->index_file);
+  p->index_file = copy;
+  p->index_slot = slot;
+  p->index_serial = p->voices[slot].serial;
+  pthread_cond_signal(&p->index_cond);
+  pthread_mutex_unlock(&p->index_lock);
+}
+
+/**
+ * Build the seek table of the given MP3 file and store it in the cache.
+ * Uses its own MP3 decoder so playback is never blocked by the file scan.
+ *
+ * @param file_name The MP3 file.
+ * @param[out] count The number of seek points.
+ * @return Newly allocated seek points, NULL on failure.
+ */
+static ma_dr_mp3_seek_point *build_seek_table(const char *file_name,
+                                              ma_uint32 *count) {
+  ma_dr_mp3 mp3;
+  if (!ma_dr_mp3_init_file(&mp3, file_name, NULL)) {
+    fprintf(stderr, "failed to open mp3 for seek table: %s\n", file_name);
+    return NULL;
+  }
+  ma_dr_mp3_seek_point *points = NULL;
+  ma_uint64 total_frames = 0;
+  if (!ma_dr_mp3_get_mp3_and_pcm_frame_count(&mp3, NULL, &total_frames) ||
+      mp3.sampleRate == 0) {
+    goto done;
+  }
+  ma_uint64 wanted = total_frames / (mp3.sampleRate * SEEK_POINT_INTERVAL_SEC);
+  if (wanted == 0) {
+    wanted = 1;
+  } else if (wanted > SEEK_POINT_MAX) {
+    wanted = SEEK_POINT_MAX;
+  }
+  *count = (ma_uint32)wanted;
+  points = malloc(sizeof(ma_dr_mp3_seek_point) * (*count));
+  if (points == NULL) {
+    goto done;
+  }
+  if (!ma_dr_mp3_calculate_seek_points(&mp3, count, points)) {
+    fprintf(stderr, "failed to calculate seek points: %s\n", file_name);
+    free(points);
+    points = NULL;
+    goto done;
+  }
+  seek_cache_store(file_name, points, sizeof(ma_dr_mp3_seek_point) * (*count),
+                   total_frames);
+
+done:
+  ma_dr_mp3_uninit(&mp3);
+  return points;
+}
+
+/**
+ * Index thread main loop.
+ * Builds seek tables for decoders that had no cached one.
+ */
+static void *index_thread_main(void *arg) {
+  struct player_t *p = (struct player_t *)arg;
+  pthread_mutex_lock(&p->index_lock);
+  while (!p->index_quit) {
+    if (p->index_file == NULL) {
+      pthread_cond_wait(&p->index_cond, &p->index_lock);
+      continue;
+    }
+    char *file_name = p->index_file;
+    int slot = p->index_slot;
+    unsigned serial = p->index_serial;
+    p->index_file = NULL;
+    pthread_mutex_unlock(&p->index_lock);
+    ma_uint32 count = 0;
+    ma_dr_mp3_seek_point *points = build_seek_table(file_name, &count);
+    free(file_name);
+    if (points != NULL) {
+      // only bind when the decoder it was built for is still open.
+      pthread_mutex_lock(&p->decode_lock);
+      if (p->voices[slot].serial == serial) {
+        bind_seek_table(p, slot, points, count);
+      } else {
+        free(points);
+      }
+      pthread_mutex_unlock(&p->decode_lock);
+    }
+    pthread_mutex_lock(&p->index_lock);
+  }
+  pthread_mutex_unlock(&p->index_lock);
+  return NULL;
+}
+
+/**
+ * Drop all decoded frames waiting in the ring buffer.
+ * Only the callback may move the read pointer while the device is running,
+ * so ask it to do the flush and wait for it.
+ */
+static void flush_ring(struct player_t *p) {
+  if (!ma_device_is_started(&p->device)) {
+    ma_pcm_rb_reset(&p->ring);
+    return;
+  }
+  atomic_store(&p->flush_requested, true);
+  const struct timespec ts = {.tv_sec = 0, .tv_nsec = 1000000L};
+  for (int i = 0; i < FLUSH_TIMEOUT_MS; ++i) {
+    if (!atomic_load(&p->flush_requested)) {
+      return;
+    }
+    nanosleep(&ts, NULL);
+  }
+  fprintf(stderr, "timed out waiting for the ring buffer flush.\n");
+  atomic_store(&p->flush_requested, false);
+}
+
+/**
+ * Free the decoder objects and drop their pending audio.
  */
 static void unconfigure(struct player_t *p) {
-  ma_device_uninit(&p->device);
-  ma_decoder_uninit(&p->decoder);
-  p->is_playing = false;
-  p->configured = false;
+  // the callback stops reading the ring as soon as it sees this.
+  atomic_store_explicit(&p->state, STATE_IDLE, memory_order_release);
+  pthread_mutex_lock(&p->decode_lock);
+  p->decoding = false;
+  p->generation++;
+  for (int i = 0; i < VOICE_COUNT; ++i) {
+    // the decode thread drops the voice it is opening once it sees the new
+    // generation.
+    if (i != p->opening) {
+      release_voice(p, i);
+    }
+  }
+  p->next = -1;
+  p->fading = -1;
+  p->fade_pos = 0;
+  p->fade_len = 0;
+  if (p->next_file != NULL) {
+    free(p->next_file);
+    p->next_file = NULL;
+  }
+  pthread_mutex_unlock(&p->decode_lock);
+  flush_ring(p);
 }
 
-static void data_callback(ma_device *pDevice, void *pOutput, const void *pInput,
-                          ma_uint32 frameCount) {
-  (void)pInput;
-  struct player_t *player = (struct player_t *)pDevice->pUserData;
-  // pause the player by not decoding more.
-  if (player->is_playing) {
+/**
+ * Wake up the decode thread.
+ * Never blocks, so it does not need the decode lock.
+ */
+static void wake_decoder(struct player_t *p) {
+  atomic_fetch_add_explicit(&p->decode_wake, 1, memory_order_release);
+  syscall(SYS_futex, &p->decode_wake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**
+ * Sleep until the decode thread is woken up or the timeout passes.
+ * Must be called with the decode lock held, it is released while sleeping.
+ *
+ * @param p The player structure.
+ * @param seq The wake count read before the decode thread last looked for
+ *  work, so wake ups since then are not slept through.
+ * @param ms The timeout in milliseconds, negative for none.
+ */
+static void decode_wait(struct player_t *p, unsigned seq, long ms) {
+  const struct timespec ts = {.tv_sec = ms / 1000,
+                              .tv_nsec = (ms % 1000) * 1000000L};
+  pthread_mutex_unlock(&p->decode_lock);
+  syscall(SYS_futex, &p->decode_wake, FUTEX_WAIT_PRIVATE, seq,
+          ms < 0 ? NULL : &ts, NULL, 0);
+  pthread_mutex_lock(&p->decode_lock);
+}
+
+/**
+ * Get the length of the decoder's audio in frames, 0 if unknown.
+ */
+static ma_uint64 decoder_length(ma_decoder *decoder) {
+  ma_uint64 length = 0;
+  if (ma_decoder_get_length_in_pcm_frames(decoder, &length) != MA_SUCCESS) {
+    return 0;
+  }
+  return length;
+}
+
+/**
+ * Open the pending next file into the spare decoder slot.
+ * Must be called with the decode lock held, the lock is released while the
+ * file is being opened so control calls are not blocked by disk access.
+ */
+static void open_next(struct player_t *p) {
+  char *file_name = p->next_file;
+  p->next_file = NULL;
+  unsigned generation = p->generation;
+  if (p->next >= 0) {
+    release_voice(p, p->next);
+    p->next = -1;
+  }
+  int slot = free_voice(p);
+  if (slot < 0) {
+    fprintf(stderr, "no free voice for the next file.\n");
+    free(file_name);
+    return;
+  }
+  // claim the voice so nothing else picks it while unlocked.
+  struct voice_t *voice = &p->voices[slot];
+  voice->in_use = true;
+  p->opening = slot;
+  pthread_mutex_unlock(&p->decode_lock);
+  ma_result result = open_voice(p, voice, file_name);
+  ma_uint64 length = 0;
+  if (result == MA_SUCCESS) {
+    attach_seek_table(p, slot, file_name, &length);
+    if (length == 0) {
+      length = decoder_length(&voice->decoder);
+    }
+  }
+  pthread_mutex_lock(&p->decode_lock);
+  p->opening = -1;
+  free(file_name);
+  if (result != MA_SUCCESS) {
+    fprintf(stderr, "failed to init next decoder file: code(%d)\n", result);
+    voice->in_use = false;
+    return;
+  }
+  // a new play happened while opening, the decoder is stale.
+  if (generation != p->generation || !p->decoding) {
+    release_voice(p, slot);
+    return;
+  }
+  voice->length = length;
+  p->next = slot;
+}
+
+/**
+ * Switch the decode thread over to the next decoder.
+ * The next decoder's frames land right after the current one's in the ring,
+ * so the switch is sample accurate for the callback.
+ * Must be called with the decode lock held.
+ */
+static void switch_to_next(struct player_t *p) {
+  release_voice(p, p->current);
+  p->current = p->next;
+  p->next = -1;
+  atomic_store_explicit(&p->next_track_length, p->voices[p->current].length,
+                        memory_order_relaxed);
+  atomic_store_explicit(&p->next_track_start, p->frames_written,
+                        memory_order_release);
+}
+
+/**
+ * Start crossfading from the current voice into the next one.
+ * The next voice becomes the current one right away, so the next track's
+ * position starts counting at the first frame of the fade.
+ * Must be called with the decode lock held.
+ *
+ * @param p The player structure.
+ * @param frames The length of the fade in frames.
+ */
+static void start_fade(struct player_t *p, ma_uint64 frames) {
+  p->fading = p->current;
+  p->fade_pos = 0;
+  p->fade_len = frames;
+  p->current = p->next;
+  p->next = -1;
+  atomic_store_explicit(&p->next_track_length, p->voices[p->current].length,
+                        memory_order_relaxed);
+  atomic_store_explicit(&p->next_track_start, p->frames_written,
+                        memory_order_release);
+}
+
+/**
+ * Stop a running crossfade and free the voice fading out, the current voice
+ * plays at full volume from here on.
+ * Must be called with the decode lock held.
+ */
+static void end_fade(struct player_t *p) {
+  if (p->fading >= 0) {
+    release_voice(p, p->fading);
+    p->fading = -1;
+  }
+  p->fade_pos = p->fade_len;
+}
+
+/**
+ * Check if the current voice is close enough to its end to start fading
+ * into the next voice.
+ * Must be called with the decode lock held.
+ */
+static void check_fade(struct player_t *p) {
+  if (p->next < 0 || p->fade_pos < p->fade_len || p->crossfade_ms == 0) {
+    return;
+  }
+  struct voice_t *voice = &p->voices[p->current];
+  ma_uint64 cursor = 0;
+  if (voice->length == 0 ||
+      ma_decoder_get_cursor_in_pcm_frames(&voice->decoder, &cursor) !=
+          MA_SUCCESS) {
+    // without a known length the tracks are played gapless instead.
+    return;
+  }
+  ma_uint64 fade_frames =
+      ((ma_uint64)p->device.sampleRate * p->crossfade_ms) / 1000;
+  ma_uint64 remaining = voice->length > cursor ? voice->length - cursor : 0;
+  if (remaining > 0 && remaining <= fade_frames) {
+    start_fade(p, remaining);
+  }
+}
+
+/**
+ * Mix the voice fading out into the freshly decoded frames of the current
+ * voice with an equal-power curve.
+ * If the voice fading out ends before the fade does, the current voice keeps
+ * ramping up on its own for the rest of the fade.
+ * Must be called with the decode lock held.
+ *
+ * @param p The player structure.
+ * @param buffer The frames of the current voice.
+ * @param frames The capacity of the buffer in frames.
+ * @param framesRead The frames the current voice put into the buffer.
+ * @return The amount of valid frames in the buffer after mixing.
+ */
+static ma_uint64 mix_fade(struct player_t *p, float *buffer, ma_uint64 frames,
+                          ma_uint64 framesRead) {
+  ma_uint64 wanted = p->fade_len - p->fade_pos;
+  if (wanted > frames) {
+    wanted = frames;
+  }
+  ma_uint64 fadeRead = 0;
+  if (p->fading >= 0) {
+    ma_decoder_read_pcm_frames(&p->voices[p->fading].decoder, p->fade_buffer,
+                               wanted, &fadeRead);
+    advise_window(&p->voices[p->fading]);
+  }
+  // the incoming track may be shorter than the fade, pad it with silence.
+  if (framesRead < fadeRead) {
+    memset(buffer + framesRead * OUTPUT_CHANNELS, 0,
+           (size_t)(fadeRead - framesRead) * OUTPUT_CHANNELS * sizeof(float));
+  }
+  ma_uint64 mixed = framesRead > fadeRead ? framesRead : fadeRead;
+  ma_uint64 span = mixed < wanted ? mixed : wanted;
+  const float half_pi = 1.57079632679f;
+  ma_uint64 done = 0;
+  while (done < span) {
+    // blocks stop where the outgoing frames do, the rest only ramps up.
+    ma_uint64 block = (done < fadeRead ? fadeRead : span) - done;
+    if (block > FADE_BLOCK_FRAMES) {
+      block = FADE_BLOCK_FRAMES;
+    }
+    float t0 = (float)(p->fade_pos + done) / (float)p->fade_len;
+    float t1 = (float)(p->fade_pos + done + block) / (float)p->fade_len;
+    if (done < fadeRead) {
+      dsp_crossfade_stereo(buffer + done * OUTPUT_CHANNELS,
+                           p->fade_buffer + done * OUTPUT_CHANNELS, block,
+                           sinf(t0 * half_pi), sinf(t1 * half_pi),
+                           cosf(t0 * half_pi), cosf(t1 * half_pi));
+    } else {
+      dsp_gain_ramp_stereo(buffer + done * OUTPUT_CHANNELS, block,
+                           sinf(t0 * half_pi), sinf(t1 * half_pi));
+    }
+    done += block;
+  }
+  p->fade_pos += span;
+  if (p->fading >= 0 && fadeRead < wanted) {
+    // nothing left to fade out, the fade itself goes on.
+    release_voice(p, p->fading);
+    p->fading = -1;
+  }
+  if (span < wanted || p->fade_pos >= p->fade_len) {
+    end_fade(p);
+  }
+  return mixed;
+}
+
+/**
+ * Seek the current audio to the given frame.
+ * Must be called with the decode lock held.
+ *
+ * @param p The player structure.
+ * @param frame The frame to seek to.
+ * @param on_decode_thread Flag for running on the decode thread, which
+ *  releases the lock while waiting for the flush.
+ * @return true for success, false for failure.
+ */
+static bool seek_current(struct player_t *p, uint64_t frame,
+                         bool on_decode_thread) {
+  // the decode thread already moved on to the next track, so the decoder of
+  // the audible track is gone.
+  if (atomic_load(&p->next_track_start) != UINT64_MAX) {
+    return false;
+  }
+  ma_uint64 length = atomic_load_explicit(&p->track_length, memory_order_relaxed);
+  if (length > 0 && frame > length) {
+    frame = length;
+  }
+  ma_result result = ma_decoder_seek_to_pcm_frame(current_decoder(p), frame);
+  if (result != MA_SUCCESS) {
+    fprintf(stderr, "failed to seek decoder: code(%d)\n", result);
+    return false;
+  }
+  // the seek jumps away from any running crossfade.
+  end_fade(p);
+  // the decoder may have already hit the end, so restart decoding.
+  atomic_store(&p->decode_ended, false);
+  p->decoding = true;
+  transition(p, STATE_DRAINING, STATE_PLAYING);
+  if (on_decode_thread) {
+    // nothing else writes the ring, so the lock is not needed to keep it
+    // empty, and posters are not held up by the wait.
+    pthread_mutex_unlock(&p->decode_lock);
+    flush_ring(p);
+    pthread_mutex_lock(&p->decode_lock);
+  } else {
+    flush_ring(p);
+  }
+  // the ring is empty and the decode thread is not writing to it, so the
+  // played count is stable until it decodes again.
+  ma_uint64 played = atomic_load(&p->frames_played);
+  p->frames_written = played;
+  atomic_store_explicit(&p->track_start, played - frame, memory_order_release);
+  // a callback that read the end flag before it was reset may have started
+  // draining again, take that back now that the flush is done.
+  transition(p, STATE_DRAINING, STATE_PLAYING);
+  wake_decoder(p);
+  return true;
+}
+
+/**
+ * Run the requests posted by the control calls, oldest first.
+ * A play or a stop replaces every request posted before it.
+ * Must be called on the decode thread with the decode lock held, the lock
+ * is released while files are opened.
+ */
+static void run_requests(struct player_t *p) {
+  struct request_t *newest =
+      atomic_exchange_explicit(&p->requests, NULL, memory_order_acquire);
+  // reverse into posting order.
+  struct request_t *oldest = NULL;
+  while (newest != NULL) {
+    struct request_t *next = newest->next;
+    newest->next = oldest;
+    oldest = newest;
+    newest = next;
+  }
+  // requests before the last play or stop are replaced by it.
+  struct request_t *start = oldest;
+  for (struct request_t *req = oldest; req != NULL; req = req->next) {
+    if (req->kind == REQUEST_PLAY || req->kind == REQUEST_STOP) {
+      start = req;
+    }
+  }
+  while (oldest != start) {
+    struct request_t *req = oldest;
+    oldest = req->next;
+    if (req->kind == REQUEST_PLAY) {
+      atomic_fetch_sub(&p->pending_plays, 1);
+    }
+    free(req);
+  }
+  // the rest is dropped once the player is being destroyed.
+  while (oldest != NULL && !p->decode_quit) {
+    struct request_t *req = oldest;
+    oldest = req->next;
+    if (req->kind == REQUEST_PLAY) {
+      pthread_mutex_unlock(&p->decode_lock);
+      if (!player_play(p, req->file_name)) {
+        fprintf(stderr, "failed to play the posted file.\n");
+      }
+      pthread_mutex_lock(&p->decode_lock);
+      atomic_fetch_sub(&p->pending_plays, 1);
+    } else if (req->kind == REQUEST_ENQUEUE) {
+      pthread_mutex_unlock(&p->decode_lock);
+      if (!player_enqueue_next(p, req->file_name)) {
+        fprintf(stderr, "failed to enqueue the posted file.\n");
+      }
+      pthread_mutex_lock(&p->decode_lock);
+    } else if (req->kind == REQUEST_SEEK) {
+      int state = load_state(p);
+      if (state != STATE_IDLE && state != STATE_ENDED) {
+        seek_current(p, req->frame, true);
+      }
+    } else if (req->kind == REQUEST_PAUSE) {
+      player_pause(p);
+    } else if (req->kind == REQUEST_RESUME) {
+      player_resume(p);
+    } else if (req->kind == REQUEST_STOP) {
+      pthread_mutex_unlock(&p->decode_lock);
+      player_stop(p);
+      pthread_mutex_lock(&p->decode_lock);
+    }
+    free(req);
+  }
+  while (oldest != NULL) {
+    struct request_t *req = oldest;
+    oldest = req->next;
+    free(req);
+  }
+}
+
+/**
+ * Decode thread main loop.
+ * Keeps the ring buffer filled so the audio callback never touches the
+ * decoder.
+ */
+static void *decode_thread_main(void *arg) {
+  struct player_t *p = (struct player_t *)arg;
+  pthread_mutex_lock(&p->decode_lock);
+  while (!p->decode_quit) {
+    // read before looking for work, so a wake up in between is not slept
+    // through.
+    unsigned seq = atomic_load_explicit(&p->decode_wake, memory_order_acquire);
+    if (atomic_load_explicit(&p->requests, memory_order_acquire) != NULL) {
+      run_requests(p);
+      continue;
+    }
+    if (!p->decoding) {
+      decode_wait(p, seq, -1);
+      continue;
+    }
+    if (p->next_file != NULL) {
+      open_next(p);
+      continue;
+    }
+    ma_uint32 frames = ma_pcm_rb_available_write(&p->ring);
+    if (frames == 0) {
+      // ring is full, give the callback time to drain it.
+      decode_wait(p, seq, DECODE_WAIT_MS);
+      continue;
+    }
+    if (frames > DECODE_CHUNK_FRAMES) {
+      frames = DECODE_CHUNK_FRAMES;
+    }
+    check_fade(p);
+    void *buffer = NULL;
+    if (ma_pcm_rb_acquire_write(&p->ring, &frames, &buffer) != MA_SUCCESS) {
+      decode_wait(p, seq, DECODE_WAIT_MS);
+      continue;
+    }
     ma_uint64 framesRead = 0;
-    ma_result result = ma_decoder_read_pcm_frames(&player->decoder, pOutput,
-                                                  frameCount, &framesRead);
+    ma_result result = ma_decoder_read_pcm_frames(current_decoder(p), buffer,
+                                                  frames, &framesRead);
+    advise_window(&p->voices[p->current]);
+    if (p->fade_pos < p->fade_len) {
+      ma_uint64 mixed = mix_fade(p, (float *)buffer, frames, framesRead);
+      if (mixed > framesRead) {
+        // the fade carries on past the end of the incoming track.
+        framesRead = mixed;
+        result = MA_SUCCESS;
+      }
+    }
+    ma_pcm_rb_commit_write(&p->ring, (ma_uint32)framesRead);
+    p->frames_written += framesRead;
+    // a callback that read the end flag before an enqueue reset it may have
+    // started draining, the ring has audio again so take that back.
+    if (framesRead > 0 &&
+        atomic_load_explicit(&p->state, memory_order_relaxed) ==
+            STATE_DRAINING) {
+      transition(p, STATE_DRAINING, STATE_PLAYING);
+    }
     if (result != MA_SUCCESS) {
       if (result != MA_AT_END) {
         fprintf(stderr, "ma_decoder_read_pcm_frames failed with code: (%d)\n",
                 result);
       }
-      // audio has ended.
-      player->has_ended = true;
-      player->is_playing = false;
-    } else {
-      if (player->cb != NULL) {
-        // get the elapsed time in seconds with frames / sample_rate
-        player->cb((double)framesRead /
-                       (double)player->decoder.outputSampleRate,
-                   player->has_ended);
+      if (p->next >= 0) {
+        switch_to_next(p);
+        continue;
+      }
+      if (p->next_file != NULL) {
+        // next file is still waiting to be opened, open it and come back.
+        continue;
+      }
+      // audio has ended, the callback drains what is left in the ring.
+      p->decoding = false;
+      atomic_store_explicit(&p->decode_ended, true, memory_order_release);
+    }
+  }
+  pthread_mutex_unlock(&p->decode_lock);
+  return NULL;
+}
+
+/**
+ * Copy up to frameCount frames out of the ring buffer.
+ *
+ * @return The number of frames copied.
+ */
+static ma_uint32 read_ring(struct player_t *p, void *pOutput,
+                           ma_uint32 frameCount) {
+  ma_uint32 bpf = ma_get_bytes_per_frame(ma_pcm_rb_get_format(&p->ring),
+                                         ma_pcm_rb_get_channels(&p->ring));
+  ma_uint32 total = 0;
+  // at most two passes, one before and one after the ring wraps around.
+  while (total < frameCount) {
+    ma_uint32 frames = frameCount - total;
+    void *buffer = NULL;
+    if (ma_pcm_rb_acquire_read(&p->ring, &frames, &buffer) != MA_SUCCESS ||
+        frames == 0) {
+      break;
+    }
+    memcpy((ma_uint8 *)pOutput + (size_t)total * bpf, buffer,
+           (size_t)frames * bpf);
+    ma_pcm_rb_commit_read(&p->ring, frames);
+    total += frames;
+  }
+  return total;
+}
+
+/**
+ * Get the monotonic clock in nanoseconds.
+ */
+static ma_uint64 monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ma_uint64)ts.tv_sec * 1000000000ULL + (ma_uint64)ts.tv_nsec;
+}
+
+/**
+ * Record how many frames were handed to the device and when.
+ * Only one thread may write the stamp at a time: the callback while
+ * playing, the control thread while idle.
+ *
+ * @param p The player structure.
+ * @param played The frames handed to the device so far.
+ * @param lowest The lowest frame to report as audible.
+ */
+static void publish_stamp(struct player_t *p, ma_uint64 played,
+                          ma_uint64 lowest) {
+  unsigned seq = atomic_load_explicit(&p->stamp_seq, memory_order_relaxed);
+  atomic_store_explicit(&p->stamp_seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&p->stamp_frames, played, memory_order_relaxed);
+  atomic_store_explicit(&p->stamp_ns, monotonic_ns(), memory_order_relaxed);
+  atomic_store_explicit(&p->stamp_floor, lowest, memory_order_relaxed);
+  atomic_store_explicit(&p->stamp_seq, seq + 2, memory_order_release);
+}
+
+/**
+ * Get the frame (in frames_played) that is audible right now.
+ * The last stamp is moved back by the device latency and forward by the
+ * time since it was taken, but never past what was handed to the device
+ * nor below the stamp's floor.
+ */
+static ma_uint64 audible_frames(struct player_t *p) {
+  ma_uint64 played = 0;
+  ma_uint64 stamp = 0;
+  ma_uint64 lowest = 0;
+  unsigned seq = 0;
+  do {
+    seq = atomic_load_explicit(&p->stamp_seq, memory_order_acquire);
+    played = atomic_load_explicit(&p->stamp_frames, memory_order_relaxed);
+    stamp = atomic_load_explicit(&p->stamp_ns, memory_order_relaxed);
+    lowest = atomic_load_explicit(&p->stamp_floor, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+  } while ((seq & 1) != 0 ||
+           seq != atomic_load_explicit(&p->stamp_seq, memory_order_relaxed));
+  ma_uint64 latency = p->latency_frames;
+  ma_uint64 heard = played > latency ? played - latency : 0;
+  ma_uint32 rate = p->device.sampleRate;
+  if (rate > 0) {
+    // past the latency everything handed over is heard, so a long pause
+    // can not overflow the conversion.
+    ma_uint64 latency_ns = latency * 1000000000ULL / rate;
+    ma_uint64 elapsed_ns = monotonic_ns() - stamp;
+    if (elapsed_ns > latency_ns) {
+      elapsed_ns = latency_ns;
+    }
+    heard += (elapsed_ns * rate) / 1000000000ULL;
+  }
+  if (heard < lowest) {
+    heard = lowest;
+  }
+  return heard < played ? heard : played;
+}
+
+/**
+ * Get the position inside the audible track of a frame in frames_played.
+ */
+static ma_uint64 track_position(struct player_t *p, ma_uint64 frame) {
+  ma_uint64 start = atomic_load_explicit(&p->track_start, memory_order_acquire);
+  // track_start wraps on a seek forward past frames_played, the difference
+  // is modular like in player_get_position_frames.
+  ma_uint64 position = frame - start;
+  // right after a seek or a track change the device still plays audio from
+  // before the new start, which comes out negative.
+  return (int64_t)position < 0 ? 0 : position;
+}
+
+/**
+ * Get the gain at the given frame of the running volume ramp.
+ */
+static float ramp_gain(struct player_t *p, ma_uint32 pos) {
+  if (pos >= p->ramp_len) {
+    return p->ramp_to;
+  }
+  float t = (float)pos / (float)p->ramp_len;
+  if (p->ramp_curve == PLAYER_RAMP_DB) {
+    float from = dsp_gain_to_db(p->ramp_from);
+    float to = dsp_gain_to_db(p->ramp_to);
+    return dsp_db_to_gain(from + (to - from) * t);
+  }
+  return p->ramp_from + (p->ramp_to - p->ramp_from) * t;
+}
+
+/**
+ * Apply the volume to the frames handed to the device, ramping to a new
+ * volume over the configured window so changes do not click.
+ */
+static void apply_gain(struct player_t *p, float *samples, ma_uint32 frames) {
+  float target = atomic_load_explicit(&p->gain_target, memory_order_relaxed);
+  if (target != p->ramp_to) {
+    // a new volume restarts the ramp from wherever the gain is right now.
+    ma_uint32 ms = atomic_load_explicit(&p->ramp_ms, memory_order_relaxed);
+    p->ramp_from = p->gain;
+    p->ramp_to = target;
+    p->ramp_curve = atomic_load_explicit(&p->ramp_law, memory_order_relaxed);
+    p->ramp_pos = 0;
+    p->ramp_len = (ma_uint32)(((ma_uint64)p->device.sampleRate * ms) / 1000);
+  }
+  ma_uint32 done = 0;
+  while (p->ramp_pos < p->ramp_len && done < frames) {
+    ma_uint32 block = p->ramp_len - p->ramp_pos;
+    if (block > frames - done) {
+      block = frames - done;
+    }
+    // dB ramps are split into short linear blocks that follow the curve.
+    if (p->ramp_curve == PLAYER_RAMP_DB && block > GAIN_BLOCK_FRAMES) {
+      block = GAIN_BLOCK_FRAMES;
+    }
+    float end = ramp_gain(p, p->ramp_pos + block);
+    dsp_gain_ramp_stereo(samples + (size_t)done * OUTPUT_CHANNELS, block,
+                         p->gain, end);
+    p->gain = end;
+    p->ramp_pos += block;
+    done += block;
+  }
+  if (p->ramp_pos >= p->ramp_len) {
+    p->gain = p->ramp_to;
+  }
+  if (done < frames && p->gain != 1.0f) {
+    dsp_gain(samples + (size_t)done * OUTPUT_CHANNELS,
+             (size_t)(frames - done) * OUTPUT_CHANNELS, p->gain);
+  }
+}
+
+static void data_callback(ma_device *pDevice, void *pOutput, const void *pInput,
+                          ma_uint32 frameCount) {
+  (void)pInput;
+  struct player_t *player = (struct player_t *)pDevice->pUserData;
+  bool flushed = false;
+  if (atomic_load(&player->flush_requested)) {
+    ma_pcm_rb_seek_read(&player->ring, ma_pcm_rb_available_read(&player->ring));
+    atomic_store(&player->flush_requested, false);
+    flushed = true;
+  }
+  // pause the player by not reading more. the ring and the track positions
+  // carry their own ordering, so a relaxed load of the state is enough.
+  int state = atomic_load_explicit(&player->state, memory_order_relaxed);
+  if (state == STATE_PLAYING || state == STATE_DRAINING) {
+    // check the end flag before reading so frames committed right before the
+    // decoder ended are not lost.
+    if (state == STATE_PLAYING &&
+        atomic_load_explicit(&player->decode_ended, memory_order_acquire) &&
+        transition(player, STATE_PLAYING, STATE_DRAINING)) {
+      state = STATE_DRAINING;
+    }
+    ma_uint32 framesRead = read_ring(player, pOutput, frameCount);
+    apply_gain(player, (float *)pOutput, framesRead);
+    ma_uint64 played =
+        atomic_fetch_add_explicit(&player->frames_played, framesRead,
+                                  memory_order_relaxed) +
+        framesRead;
+    // periods without new audio keep the old stamp, so the position keeps
+    // running while the device plays out what it already has.
+    if (framesRead > 0) {
+      ma_uint64 lowest =
+          atomic_load_explicit(&player->stamp_floor, memory_order_relaxed);
+      if (player->stalled) {
+        // the device played out everything before the stall, the new audio
+        // is only heard after the latency. hold the position until then
+        // instead of jumping back.
+        lowest = audible_frames(player);
+        player->stalled = false;
       }
+      publish_stamp(player, played, lowest);
+    } else {
+      player->stalled = true;
+    }
+    // flip the audible track once the next track's first frame is played.
+    ma_uint64 boundary = atomic_load_explicit(&player->next_track_start,
+                                              memory_order_acquire);
+    if (played >= boundary &&
+        atomic_compare_exchange_strong(&player->next_track_start, &boundary,
+                                       UINT64_MAX)) {
+      atomic_store_explicit(&player->track_length,
+                            atomic_load_explicit(&player->next_track_length,
+                                                 memory_order_relaxed),
+                            memory_order_relaxed);
+      atomic_store_explicit(&player->track_start, boundary,
+                            memory_order_release);
+    }
+    bool ended = false;
+    // the ring is empty right after a flush, that is not the end.
+    if (state == STATE_DRAINING && !flushed && framesRead < frameCount) {
+      // audio has ended, unless the control thread got in between.
+      ended = transition(player, STATE_DRAINING, STATE_ENDED);
     }
+    if (player->cb != NULL) {
+      // hand out the integer frame cursor of what is heard, consumers convert
+      // it to seconds when they read it.
+      ma_uint64 latency = player->latency_frames;
+      player->cb(track_position(player, played > latency ? played - latency : 0),
+                 ended);
+    }
+  } else {
+    player->stalled = true;
   }
 }
 
@@ -69,11 +1300,142 @@ struct player_t *player_create(playback_cb cb) {
   if (result == NULL) {
     return NULL;
   }
-  result->is_playing = false;
-  result->has_ended = false;
-  result->configured = false;
+  atomic_init(&result->volume, 1.0f);
+  atomic_init(&result->gain_target, 1.0f);
+  atomic_init(&result->ramp_ms, VOLUME_RAMP_MS);
+  atomic_init(&result->ramp_law, PLAYER_RAMP_DB);
+  result->gain = 1.0f;
+  result->ramp_from = 1.0f;
+  result->ramp_to = 1.0f;
+  result->ramp_curve = PLAYER_RAMP_DB;
+  result->ramp_pos = 0;
+  result->ramp_len = 0;
+  atomic_init(&result->state, STATE_IDLE);
   result->cb = cb;
+  for (int i = 0; i < VOICE_COUNT; ++i) {
+    result->voices[i].seek_points = NULL;
+    result->voices[i].length = 0;
+    result->voices[i].mapping = NULL;
+    result->voices[i].mapping_size = 0;
+    result->voices[i].advised_end = 0;
+    result->voices[i].serial = 0;
+    result->voices[i].in_use = false;
+  }
+  result->current = 0;
+  result->next = -1;
+  result->fading = -1;
+  result->opening = -1;
+  result->fade_pos = 0;
+  result->fade_len = 0;
+  result->crossfade_ms = 0;
+  result->index_file = NULL;
+  result->index_slot = 0;
+  result->index_serial = 0;
+  result->index_quit = false;
+  result->decoding = false;
+  result->decode_quit = false;
+  result->next_file = NULL;
+  atomic_init(&result->decode_wake, 0);
+  atomic_init(&result->requests, NULL);
+  atomic_init(&result->pending_plays, 0);
+  result->generation = 0;
+  result->frames_written = 0;
+  atomic_init(&result->decode_ended, false);
+  atomic_init(&result->flush_requested, false);
+  atomic_init(&result->frames_played, 0);
+  atomic_init(&result->stamp_seq, 0);
+  atomic_init(&result->stamp_frames, 0);
+  atomic_init(&result->stamp_ns, 0);
+  atomic_init(&result->stamp_floor, 0);
+  result->stalled = true;
+  result->latency_frames = 0;
+  atomic_init(&result->track_start, 0);
+  atomic_init(&result->track_length, 0);
+  atomic_init(&result->next_track_start, UINT64_MAX);
+  atomic_init(&result->next_track_length, 0);
+  // open the context and device once, every track is converted to this
+  // device's format so switching tracks never touches it.
+  ma_result ma_res = ma_context_init(NULL, 0, NULL, &result->context);
+  if (ma_res != MA_SUCCESS) {
+    fprintf(stderr, "failed to init context: code(%d)\n", ma_res);
+    free(result);
+    return NULL;
+  }
+  result->config = ma_device_config_init(ma_device_type_playback);
+  result->config.playback.format = OUTPUT_FORMAT;
+  result->config.playback.channels = OUTPUT_CHANNELS;
+  // use the device's native sample rate.
+  result->config.sampleRate = 0;
+  result->config.dataCallback = data_callback;
+  result->config.pUserData = result;
+  ma_res = ma_device_init(&result->context, &result->config, &result->device);
+  if (ma_res != MA_SUCCESS) {
+    fprintf(stderr, "failed to init device: code(%d)\n", ma_res);
+    ma_context_uninit(&result->context);
+    free(result);
+    return NULL;
+  }
+  // everything in the device's buffer is still ahead of the speakers.
+  if (result->device.playback.internalSampleRate != 0) {
+    result->latency_frames =
+        ((ma_uint64)result->device.playback.internalPeriodSizeInFrames *
+         result->device.playback.internalPeriods * result->device.sampleRate) /
+        result->device.playback.internalSampleRate;
+  }
+  // setup the ring buffer between the decode thread and the callback.
+  ma_uint32 ring_frames = (result->device.sampleRate * RING_BUFFER_MS) / 1000;
+  ma_res = ma_pcm_rb_init(result->device.playback.format,
+                          result->device.playback.channels, ring_frames, NULL,
+                          NULL, &result->ring);
+  if (ma_res != MA_SUCCESS) {
+    fprintf(stderr, "failed to init ring buffer: code(%d)\n", ma_res);
+    ma_device_uninit(&result->device);
+    ma_context_uninit(&result->context);
+    free(result);
+    return NULL;
+  }
+  if (pthread_mutex_init(&result->decode_lock, NULL) != 0) {
+    fprintf(stderr, "failed to init decode lock.\n");
+    goto error_ring;
+  }
+  if (pthread_create(&result->decode_thread, NULL, decode_thread_main,
+                     result) != 0) {
+    fprintf(stderr, "failed to create decode thread.\n");
+    goto error_lock;
+  }
+  if (pthread_mutex_init(&result->index_lock, NULL) != 0) {
+    fprintf(stderr, "failed to init index lock.\n");
+    goto error_decode_thread;
+  }
+  if (pthread_cond_init(&result->index_cond, NULL) != 0) {
+    fprintf(stderr, "failed to init index condition.\n");
+    goto error_index_lock;
+  }
+  if (pthread_create(&result->index_thread, NULL, index_thread_main,
+                     result) != 0) {
+    fprintf(stderr, "failed to create index thread.\n");
+    goto error_index_cond;
+  }
   return result;
+
+error_index_cond:
+  pthread_cond_destroy(&result->index_cond);
+error_index_lock:
+  pthread_mutex_destroy(&result->index_lock);
+error_decode_thread:
+  pthread_mutex_lock(&result->decode_lock);
+  result->decode_quit = true;
+  pthread_mutex_unlock(&result->decode_lock);
+  wake_decoder(result);
+  pthread_join(result->decode_thread, NULL);
+error_lock:
+  pthread_mutex_destroy(&result->decode_lock);
+error_ring:
+  ma_pcm_rb_uninit(&result->ring);
+  ma_device_uninit(&result->device);
+  ma_context_uninit(&result->context);
+  free(result);
+  return NULL;
 }
 
 /**
@@ -86,50 +1448,296 @@ struct player_t *player_create(playback_cb cb) {
 bool player_play(struct player_t *p, const char *file_name) {
   if (p == NULL)
     return false;
-  // deinitialize the old device and decoder.
-  if (p->configured) {
+  // deinitialize the old decoder.
+  if (load_state(p) != STATE_IDLE) {
     unconfigure(p);
   }
-  // init decoder with audio file.
-  ma_result result = ma_decoder_init_file(file_name, NULL, &p->decoder);
+  // init decoder with audio file, converted to the device's format.
+  pthread_mutex_lock(&p->decode_lock);
+  p->current = free_voice(p);
+  pthread_mutex_unlock(&p->decode_lock);
+  ma_decoder *decoder = current_decoder(p);
+  ma_result result = open_voice(p, &p->voices[p->current], file_name);
   if (result != MA_SUCCESS) {
     fprintf(stderr, "failed to init decoder file: code(%d)\n", result);
     return false;
   }
-  // setup device config.
-  p->config = ma_device_config_init(ma_device_type_playback);
-  p->config.playback.format = p->decoder.outputFormat;
-  p->config.playback.channels = p->decoder.outputChannels;
-  p->config.sampleRate = p->decoder.outputSampleRate;
-  p->config.dataCallback = data_callback;
-  p->config.pUserData = p;
-  result = ma_device_init(NULL, &p->config, &p->device);
-  if (result != MA_SUCCESS) {
-    fprintf(stderr, "failed to init device: code(%d)\n", result);
-    ma_decoder_uninit(&p->decoder);
+  p->voices[p->current].in_use = true;
+  ma_uint64 length = 0;
+  attach_seek_table(p, p->current, file_name, &length);
+  if (length == 0) {
+    length = decoder_length(decoder);
+  }
+  p->voices[p->current].length = length;
+  p->frames_written = 0;
+  atomic_store(&p->decode_ended, false);
+  atomic_store(&p->frames_played, 0);
+  publish_stamp(p, 0, 0);
+  atomic_store(&p->track_start, 0);
+  atomic_store(&p->track_length, length);
+  atomic_store(&p->next_track_start, UINT64_MAX);
+  // prefill the ring so the first period does not underrun.
+  pthread_mutex_lock(&p->decode_lock);
+  p->decoding = true;
+  wake_decoder(p);
+  pthread_mutex_unlock(&p->decode_lock);
+  // start the device if it was stopped, otherwise it keeps running across
+  // tracks.
+  if (!ma_device_is_started(&p->device)) {
+    ma_result start_result = ma_device_start(&p->device);
+    if (start_result != MA_SUCCESS) {
+      fprintf(stderr, "failed to start device: code(%d)\n", start_result);
+      unconfigure(p);
+      return false;
+    }
+  }
+  atomic_store_explicit(&p->state, STATE_PLAYING, memory_order_release);
+  return true;
+}
+
+/**
+ * Enqueue the next audio file to play once the current one ends.
+ * The file is opened in the background by the decode thread and played
+ * back to back with the current audio, also when the decoder already hit
+ * the end and only the ring is left to play out.
+ *
+ * @param p The player structure.
+ * @param file_name The audio file.
+ * @return true for success, false for failure.
+ */
+bool player_enqueue_next(struct player_t *p, const char *file_name) {
+  if (p == NULL || file_name == NULL)
     return false;
+  pthread_mutex_lock(&p->decode_lock);
+  int state = load_state(p);
+  bool queued = p->decoding || state == STATE_PLAYING ||
+                state == STATE_DRAINING || state == STATE_PAUSED;
+  if (queued) {
+    char *copy = strdup(file_name);
+    if (copy == NULL) {
+      pthread_mutex_unlock(&p->decode_lock);
+      return false;
+    }
+    if (p->next_file != NULL) {
+      free(p->next_file);
+    }
+    p->next_file = copy;
+    if (!p->decoding) {
+      // the current decoder is at its end, so the decode thread switches
+      // to the next one right away and appends it after the queued frames.
+      atomic_store(&p->decode_ended, false);
+      p->decoding = true;
+      transition(p, STATE_DRAINING, STATE_PLAYING);
+    }
+    wake_decoder(p);
   }
-  // start the device to start playback.
-  ma_result start_result = ma_device_start(&p->device);
-  if (start_result != MA_SUCCESS) {
-    fprintf(stderr, "failed to start device: code(%d)\n", start_result);
-    unconfigure(p);
+  pthread_mutex_unlock(&p->decode_lock);
+  // the ring already ran dry, so there is nothing to be gapless with.
+  if (!queued) {
+    return player_play(p, file_name);
+  }
+  return true;
+}
+
+/**
+ * Seek the current audio to the given frame.
+ *
+ * @param p The player structure.
+ * @param frame The frame to seek to, in the player's sample rate.
+ * @return true for success, false for failure.
+ */
+bool player_seek(struct player_t *p, uint64_t frame) {
+  if (p == NULL)
+    return false;
+  int state = load_state(p);
+  if (state == STATE_IDLE || state == STATE_ENDED)
+    return false;
+  pthread_mutex_lock(&p->decode_lock);
+  bool result = seek_current(p, frame, false);
+  pthread_mutex_unlock(&p->decode_lock);
+  return result;
+}
+
+/**
+ * Seek the current audio relative to the current position.
+ *
+ * @param p The player structure.
+ * @param offset The amount of frames to move, negative to move backwards.
+ * @return true for success, false for failure.
+ */
+bool player_seek_relative(struct player_t *p, int64_t offset) {
+  if (p == NULL)
+    return false;
+  if (load_state(p) == STATE_IDLE)
+    return false;
+  ma_uint64 start = atomic_load_explicit(&p->track_start, memory_order_acquire);
+  ma_uint64 current =
+      atomic_load_explicit(&p->frames_played, memory_order_relaxed) - start;
+  ma_uint64 target = 0;
+  if (offset >= 0) {
+    target = current + (ma_uint64)offset;
+  } else if ((ma_uint64)0 - (ma_uint64)offset < current) {
+    target = current - ((ma_uint64)0 - (ma_uint64)offset);
+  }
+  return player_seek(p, target);
+}
+
+/**
+ * Post a request to the decode thread.
+ * Never takes the decode lock, which the decode thread holds for a whole
+ * chunk.
+ *
+ * @param p The player structure.
+ * @param kind One of request_kind_t.
+ * @param file_name The file of the request, NULL for none.
+ * @param frame The frame of the request.
+ * @return true if the request was posted, false otherwise.
+ */
+static bool post_request(struct player_t *p, int kind, const char *file_name,
+                         uint64_t frame) {
+  size_t len = file_name != NULL ? strlen(file_name) : 0;
+  struct request_t *req = malloc(sizeof(struct request_t) + len + 1);
+  if (req == NULL) {
     return false;
   }
-  // setup flags.
-  p->is_playing = true;
-  p->configured = true;
-  p->has_ended = false;
+  req->kind = kind;
+  req->frame = frame;
+  if (len > 0) {
+    memcpy(req->file_name, file_name, len);
+  }
+  req->file_name[len] = '\0';
+  if (kind == REQUEST_PLAY) {
+    atomic_fetch_add(&p->pending_plays, 1);
+  }
+  struct request_t *head =
+      atomic_load_explicit(&p->requests, memory_order_relaxed);
+  do {
+    req->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &p->requests, &head, req, memory_order_release, memory_order_relaxed));
+  wake_decoder(p);
   return true;
 }
 
+/**
+ * Post a play of the given audio file to the decode thread.
+ *
+ * @param p The player structure.
+ * @param file_name The audio file.
+ * @return true if the play was posted, false otherwise.
+ */
+bool player_post_play(struct player_t *p, const char *file_name) {
+  if (p == NULL || file_name == NULL)
+    return false;
+  return post_request(p, REQUEST_PLAY, file_name, 0);
+}
+
+/**
+ * Post an enqueue of the given audio file to the decode thread.
+ *
+ * @param p The player structure.
+ * @param file_name The audio file.
+ * @return true if the enqueue was posted, false otherwise.
+ */
+bool player_post_enqueue_next(struct player_t *p, const char *file_name) {
+  if (p == NULL || file_name == NULL)
+    return false;
+  return post_request(p, REQUEST_ENQUEUE, file_name, 0);
+}
+
+/**
+ * Post a seek of the current audio to the decode thread.
+ *
+ * @param p The player structure.
+ * @param frame The frame to seek to, in the player's sample rate.
+ * @return true if the seek was posted, false otherwise.
+ */
+bool player_post_seek(struct player_t *p, uint64_t frame) {
+  if (p == NULL)
+    return false;
+  int state = load_state(p);
+  if ((state == STATE_IDLE || state == STATE_ENDED) &&
+      atomic_load(&p->pending_plays) == 0)
+    return false;
+  return post_request(p, REQUEST_SEEK, NULL, frame);
+}
+
+/**
+ * Post a pause to the decode thread, behind the requests before it.
+ *
+ * @param p The player structure.
+ * @return true if the pause was posted, false otherwise.
+ */
+bool player_post_pause(struct player_t *p) {
+  if (p == NULL)
+    return false;
+  return post_request(p, REQUEST_PAUSE, NULL, 0);
+}
+
+/**
+ * Post a resume to the decode thread, behind the requests before it.
+ *
+ * @param p The player structure.
+ * @return true if the resume was posted, false otherwise.
+ */
+bool player_post_resume(struct player_t *p) {
+  if (p == NULL)
+    return false;
+  return post_request(p, REQUEST_RESUME, NULL, 0);
+}
+
+/**
+ * Post a stop to the decode thread, it replaces the requests before it.
+ *
+ * @param p The player structure.
+ * @return true if the stop was posted, false otherwise.
+ */
+bool player_post_stop(struct player_t *p) {
+  if (p == NULL)
+    return false;
+  return post_request(p, REQUEST_STOP, NULL, 0);
+}
+
+/**
+ * Get the sample rate of the player's output.
+ *
+ * @param p The player structure.
+ * @return The sample rate, 0 if unknown.
+ */
+uint32_t player_get_sample_rate(struct player_t *p) {
+  if (p == NULL)
+    return 0;
+  return p->device.sampleRate;
+}
+
+/**
+ * Set the crossfade between consecutive tracks.
+ *
+ * @param p The player structure.
+ * @param ms The crossfade length in milliseconds, 0 for gapless playback.
+ *  Clamped to 12 seconds.
+ */
+void player_set_crossfade(struct player_t *p, uint32_t ms) {
+  if (p == NULL)
+    return;
+  if (ms > CROSSFADE_MAX_MS) {
+    ms = CROSSFADE_MAX_MS;
+  }
+  pthread_mutex_lock(&p->decode_lock);
+  p->crossfade_ms = ms;
+  pthread_mutex_unlock(&p->decode_lock);
+}
+
 /**
  * Pause the player.
  */
 void player_pause(struct player_t *p) {
   if (p == NULL)
     return;
-  p->is_playing = false;
+  // a draining player resumes as playing and drains again.
+  if (!transition(p, STATE_PLAYING, STATE_PAUSED)) {
+    transition(p, STATE_DRAINING, STATE_PAUSED);
+  }
 }
 /**
  * Resume the player.
@@ -137,7 +1745,7 @@ void player_pause(struct player_t *p) {
 void player_resume(struct player_t *p) {
   if (p == NULL)
     return;
-  p->is_playing = true;
+  transition(p, STATE_PAUSED, STATE_PLAYING);
 }
 /**
  * Stop the player.
@@ -148,6 +1756,10 @@ void player_resume(struct player_t *p) {
 bool player_stop(struct player_t *p) {
   if (p == NULL)
     return false;
+  // drop the song so the player can be reused with player_play.
+  if (load_state(p) != STATE_IDLE) {
+    unconfigure(p);
+  }
   ma_result result = ma_device_stop(&p->device);
   if (result != MA_SUCCESS) {
     fprintf(stderr, "failed to stop device. code(%d)\n", result);
@@ -163,7 +1775,32 @@ bool player_has_stopped(struct player_t *p) {
   if (p == NULL) {
     return true;
   }
-  return p->has_ended;
+  return load_state(p) == STATE_ENDED;
+}
+
+/**
+ * Get the flag for if the player is handing audio to the device.
+ */
+bool player_is_playing(struct player_t *p) {
+  if (p == NULL) {
+    return false;
+  }
+  int state = load_state(p);
+  // a posted play is reported right away, the decode thread starts it.
+  return state == STATE_PLAYING || state == STATE_DRAINING ||
+         atomic_load(&p->pending_plays) > 0;
+}
+
+/**
+ * Get the flag for if a song is loaded, whether it is playing or paused.
+ */
+bool player_in_progress(struct player_t *p) {
+  if (p == NULL) {
+    return false;
+  }
+  int state = load_state(p);
+  return (state != STATE_IDLE && state != STATE_ENDED) ||
+         atomic_load(&p->pending_plays) > 0;
 }
 
 /**
@@ -172,21 +1809,15 @@ bool player_has_stopped(struct player_t *p) {
  * @return float value between 0 - 1.
  */
 float player_get_volume(struct player_t *p) {
-  float out = 0.0;
-  if (p == NULL || !p->is_playing) {
-    return out;
-  }
-  ma_result result = ma_device_get_master_volume(&p->device, &out);
-  if (result != MA_SUCCESS) {
-    fprintf(stderr, "failed to get master volume for device: code(%d).\n",
-            result);
+  if (p == NULL) {
     return 0.0;
   }
-  return out;
+  return atomic_load_explicit(&p->volume, memory_order_relaxed);
 }
 
 /**
  * Set the volume of the player.
+ * The volume follows a dB curve, so equal steps sound equally loud.
  *
  * @param p The player structure.
  * @param volume The volume to set. Value must be between 0 - 1.
@@ -194,11 +1825,64 @@ float player_get_volume(struct player_t *p) {
 void player_set_volume(struct player_t *p, float volume) {
   if (p == NULL)
     return;
-  ma_result result = ma_device_set_master_volume(&p->device, volume);
-  if (result != MA_SUCCESS) {
-    fprintf(stderr, "failed to set master volume for device: code(%d).\n",
-            result);
+  if (!(volume > 0.0f)) {
+    volume = 0.0f;
+  } else if (volume > 1.0f) {
+    volume = 1.0f;
+  }
+  atomic_store_explicit(&p->volume, volume, memory_order_relaxed);
+  // 0 is muted, the rest of the range maps onto VOLUME_RANGE_DB of gain.
+  float gain = volume == 0.0f
+                   ? 0.0f
+                   : dsp_db_to_gain(VOLUME_RANGE_DB * (volume - 1.0f));
+  atomic_store_explicit(&p->gain_target, gain, memory_order_relaxed);
+}
+
+/**
+ * Set the volume of the player in decibels.
+ *
+ * @param p The player structure.
+ * @param db The gain in decibels, 0 for unity. Clamped to 0 dB.
+ */
+void player_set_volume_db(struct player_t *p, float db) {
+  if (p == NULL)
+    return;
+  if (db > 0.0f) {
+    db = 0.0f;
+  }
+  float gain = dsp_db_to_gain(db);
+  float volume = 1.0f + db / VOLUME_RANGE_DB;
+  atomic_store_explicit(&p->volume, volume < 0.0f ? 0.0f : volume,
+                        memory_order_relaxed);
+  atomic_store_explicit(&p->gain_target, gain, memory_order_relaxed);
+}
+
+/**
+ * Get the volume of the player in decibels.
+ */
+float player_get_volume_db(struct player_t *p) {
+  if (p == NULL)
+    return DSP_SILENCE_DB;
+  return dsp_gain_to_db(
+      atomic_load_explicit(&p->gain_target, memory_order_relaxed));
+}
+
+/**
+ * Set how volume changes are ramped in.
+ *
+ * @param p The player structure.
+ * @param ms The ramp length in milliseconds, 0 to jump. Clamped to 2 seconds.
+ * @param law The curve of the ramp.
+ */
+void player_set_volume_ramp(struct player_t *p, uint32_t ms,
+                            enum player_ramp_law law) {
+  if (p == NULL)
+    return;
+  if (ms > VOLUME_RAMP_MAX_MS) {
+    ms = VOLUME_RAMP_MAX_MS;
   }
+  atomic_store_explicit(&p->ramp_law, law, memory_order_relaxed);
+  atomic_store_explicit(&p->ramp_ms, ms, memory_order_relaxed);
 }
 
 /**
@@ -211,16 +1895,12 @@ void player_set_volume(struct player_t *p, float volume) {
 bool player_get_current_playtime(struct player_t *p, uint64_t *playtime) {
   if (p == NULL)
     return false;
-  if (!p->configured)
-    return false;
-  // get the current frame the decoder is on.
-  ma_uint64 currentFrame = 0;
-  ma_result result =
-      ma_decoder_get_cursor_in_pcm_frames(&p->decoder, &currentFrame);
-  if (result != MA_SUCCESS) {
+  if (load_state(p) == STATE_IDLE)
     return false;
-  }
-  ma_uint32 sampleRate = p->decoder.outputSampleRate;
+  // the decoder runs ahead of the device by the ring buffer and the device
+  // runs ahead of the speakers by its buffer, so count what is heard.
+  ma_uint64 currentFrame = track_position(p, audible_frames(p));
+  ma_uint32 sampleRate = p->device.sampleRate;
   if (sampleRate == 0) {
     fprintf(stderr, "player_get_length: sample rate was 0.\n");
     return false;
@@ -230,6 +1910,40 @@ bool player_get_current_playtime(struct player_t *p, uint64_t *playtime) {
   return true;
 }
 
+/**
+ * Get the position of the audible track in frames that were handed to the
+ * device, without latency compensation.
+ *
+ * @param p The player structure.
+ * @param[out] position The position in frames.
+ * @return True on success, false otherwise.
+ */
+bool player_get_position_frames(struct player_t *p, uint64_t *position) {
+  if (p == NULL)
+    return false;
+  if (load_state(p) == STATE_IDLE)
+    return false;
+  ma_uint64 start = atomic_load_explicit(&p->track_start, memory_order_acquire);
+  *position = atomic_load_explicit(&p->frames_played, memory_order_relaxed) - start;
+  return true;
+}
+
+/**
+ * Get the position of the audible track in frames as it is heard right now.
+ *
+ * @param p The player structure.
+ * @param[out] position The position in frames.
+ * @return True on success, false otherwise.
+ */
+bool player_get_position(struct player_t *p, uint64_t *position) {
+  if (p == NULL)
+    return false;
+  if (load_state(p) == STATE_IDLE)
+    return false;
+  *position = track_position(p, audible_frames(p));
+  return true;
+}
+
 /**
  * Get the total length of the audio in seconds.
  *
@@ -240,16 +1954,15 @@ bool player_get_current_playtime(struct player_t *p, uint64_t *playtime) {
 bool player_get_length(struct player_t *p, uint64_t *length) {
   if (p == NULL)
     return false;
-  if (!p->configured)
+  if (load_state(p) == STATE_IDLE)
     return false;
-  // get the total amount of frames.
-  ma_uint64 totalFrames = 0;
-  ma_result result =
-      ma_decoder_get_length_in_pcm_frames(&p->decoder, &totalFrames);
-  if (result != MA_SUCCESS) {
+  // get the total amount of frames of the audible track.
+  ma_uint64 totalFrames =
+      atomic_load_explicit(&p->track_length, memory_order_relaxed);
+  if (totalFrames == 0) {
     return false;
   }
-  ma_uint32 sample_rate = p->decoder.outputSampleRate;
+  ma_uint32 sample_rate = p->device.sampleRate;
   if (sample_rate == 0) {
     fprintf(stderr, "player_get_length: sample rate was 0.\n");
     return false;
@@ -269,9 +1982,36 @@ void player_destroy(struct player_t **p) {
   if ((*p) == NULL) {
     return;
   }
-  if ((*p)->configured) {
+  // shutdown the index thread first, it binds tables under the decode lock.
+  pthread_mutex_lock(&(*p)->index_lock);
+  (*p)->index_quit = true;
+  pthread_cond_signal(&(*p)->index_cond);
+  pthread_mutex_unlock(&(*p)->index_lock);
+  pthread_join((*p)->index_thread, NULL);
+  pthread_cond_destroy(&(*p)->index_cond);
+  pthread_mutex_destroy(&(*p)->index_lock);
+  free((*p)->index_file);
+  // shutdown the decode thread next, a posted play it runs opens voices and
+  // starts the device.
+  pthread_mutex_lock(&(*p)->decode_lock);
+  (*p)->decode_quit = true;
+  pthread_mutex_unlock(&(*p)->decode_lock);
+  wake_decoder(*p);
+  pthread_join((*p)->decode_thread, NULL);
+  // requests the decode thread did not get to are never run.
+  struct request_t *req = atomic_exchange(&(*p)->requests, NULL);
+  while (req != NULL) {
+    struct request_t *next = req->next;
+    free(req);
+    req = next;
+  }
+  if (load_state(*p) != STATE_IDLE) {
     unconfigure(*p);
   }
+  ma_device_uninit(&(*p)->device);
+  ma_context_uninit(&(*p)->context);
+  pthread_mutex_destroy(&(*p)->decode_lock);
+  ma_pcm_rb_uninit(&(*p)->ring);
   free(*p);
   *p = NULL;
 }
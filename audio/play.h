@@ -10,9 +10,11 @@
 struct player_t;
 
 /**
- * Callback function typedef for when playback ends.
+ * Callback function typedef for playback updates.
+ * Called once per device period with the position of the song as it is
+ * heard, in frames of the player's sample rate, and when playback ends.
  */
-typedef void(*playback_cb)(double elapsed_time, bool ended);
+typedef void(*playback_cb)(uint64_t position, bool ended);
 
 /**
  * Create a player.
@@ -31,6 +33,123 @@ struct player_t * player_create(playback_cb cb);
  */
 bool player_play(struct player_t *p, const char *file_name);
 
+/**
+ * Enqueue the next song file to play right after the current one ends.
+ * The file is opened in the background while the current song is playing
+ * so there is no gap between the songs. If nothing is playing, the file is
+ * played immediately.
+ *
+ * @param[in] p The player structure.
+ * @param[in] file_name The song's file name. Must be full/relative path.
+ * @return True if successful, false otherwise.
+ */
+bool player_enqueue_next(struct player_t *p, const char *file_name);
+
+/**
+ * Set the crossfade between consecutive songs.
+ * Songs enqueued with player_enqueue_next fade into each other over this
+ * length with an equal-power curve.
+ *
+ * @param[in] p The player structure.
+ * @param[in] ms The crossfade length in milliseconds, 0 for gapless playback.
+ *  Clamped to 12 seconds.
+ */
+void player_set_crossfade(struct player_t *p, uint32_t ms);
+
+/**
+ * Seek the current song to the given frame.
+ *
+ * @param[in] p The player structure.
+ * @param[in] frame The frame to seek to, in the player's sample rate.
+ * @return True if successful, false otherwise.
+ */
+bool player_seek(struct player_t *p, uint64_t frame);
+
+/**
+ * Seek the current song relative to the current position.
+ *
+ * @param[in] p The player structure.
+ * @param[in] offset The amount of frames to move, negative to move backwards.
+ * @return True if successful, false otherwise.
+ */
+bool player_seek_relative(struct player_t *p, int64_t offset);
+
+/**
+ * Post a play of the given song file to the decode thread.
+ * Returns right away, the file is opened and started by the decode thread.
+ * Until then the player reports the song as playing.
+ *
+ * @param[in] p The player structure.
+ * @param[in] file_name The song's file name. Must be full/relative path.
+ * @return True if the play was posted, false otherwise.
+ */
+bool player_post_play(struct player_t *p, const char *file_name);
+
+/**
+ * Post an enqueue of the next song file to the decode thread.
+ * Returns right away, see player_enqueue_next.
+ *
+ * @param[in] p The player structure.
+ * @param[in] file_name The song's file name. Must be full/relative path.
+ * @return True if the enqueue was posted, false otherwise.
+ */
+bool player_post_enqueue_next(struct player_t *p, const char *file_name);
+
+/**
+ * Post a seek of the current song to the decode thread.
+ * Returns right away, see player_seek.
+ *
+ * @param[in] p The player structure.
+ * @param[in] frame The frame to seek to, in the player's sample rate.
+ * @return True if the seek was posted, false otherwise.
+ */
+bool player_post_seek(struct player_t *p, uint64_t frame);
+
+/**
+ * Post a pause to the decode thread.
+ * Returns right away, the pause takes effect after the requests posted
+ * before it, so it is never undone by a play still pending.
+ *
+ * @param[in] p The player structure.
+ * @return True if the pause was posted, false otherwise.
+ */
+bool player_post_pause(struct player_t *p);
+
+/**
+ * Post a resume to the decode thread.
+ * Returns right away, see player_post_pause.
+ *
+ * @param[in] p The player structure.
+ * @return True if the resume was posted, false otherwise.
+ */
+bool player_post_resume(struct player_t *p);
+
+/**
+ * Post a stop to the decode thread.
+ * Returns right away, pending plays are dropped and the song is unloaded
+ * by the decode thread.
+ *
+ * @param[in] p The player structure.
+ * @return True if the stop was posted, false otherwise.
+ */
+bool player_post_stop(struct player_t *p);
+
+/**
+ * Get the sample rate of the player's output.
+ * Frame positions of the player are in this rate.
+ */
+uint32_t player_get_sample_rate(struct player_t *p);
+
+/**
+ * Curve of a volume change ramp.
+ */
+enum player_ramp_law {
+  /* Ramp linearly in gain. */
+  PLAYER_RAMP_LINEAR = 0,
+  /* Ramp linearly in decibels. */
+  PLAYER_RAMP_DB = 1,
+};
+
 /**
  * Get the volume of the player.
  */
@@ -38,9 +157,41 @@ float player_get_volume(struct player_t *p);
 
 /**
  * Set the volume of the player.
+ * The 0 - 1 range follows a perceptual dB curve: 1 is unity gain, every
+ * step below it lowers the level by the same amount of decibels down to
+ * -40 dB, and 0 mutes.
+ *
+ * @param[in] p The player structure.
+ * @param[in] volume The volume between 0 - 1.
  */
 void player_set_volume(struct player_t *p, float volume);
 
+/**
+ * Set the volume of the player in decibels.
+ *
+ * @param[in] p The player structure.
+ * @param[in] db The gain in decibels, 0 for unity. Clamped to 0 dB.
+ */
+void player_set_volume_db(struct player_t *p, float db);
+
+/**
+ * Get the volume of the player in decibels.
+ */
+float player_get_volume_db(struct player_t *p);
+
+/**
+ * Set how volume changes are ramped in.
+ * Changes are applied sample by sample over this window so they do not
+ * click. Defaults to a 30 ms ramp in decibels.
+ *
+ * @param[in] p The player structure.
+ * @param[in] ms The ramp length in milliseconds, 0 to jump. Clamped to 2
+ *  seconds.
+ * @param[in] law The curve of the ramp.
+ */
+void player_set_volume_ramp(struct player_t *p, uint32_t ms,
+                            enum player_ramp_law law);
+
 /**
  * Pause the player.
  */
@@ -52,6 +203,7 @@ void player_resume(struct player_t *p);
 
 /**
  * Stop the player.
+ * Unloads the current song and stops the device until the next play.
  */
 bool player_stop(struct player_t *p);
 
@@ -60,6 +212,16 @@ bool player_stop(struct player_t *p);
  */
 bool player_has_stopped(struct player_t *p);
 
+/**
+ * Flag for if the player is playing, false while paused or stopped.
+ */
+bool player_is_playing(struct player_t *p);
+
+/**
+ * Flag for if a song is loaded, whether it is playing or paused.
+ */
+bool player_in_progress(struct player_t *p);
+
 /**
  * Get the current playtime in seconds.
  *
@@ -69,6 +231,28 @@ bool player_has_stopped(struct player_t *p);
  */
 bool player_get_current_playtime(struct player_t *p, uint64_t *playtime);
 
+/**
+ * Get the current position of the song in frames.
+ * This is what was handed to the device, which plays it out later by its
+ * buffer latency. Convert to seconds with player_get_sample_rate.
+ *
+ * @param p The player structure.
+ * @param position The position in frames.
+ * @return True on success, false otherwise.
+ */
+bool player_get_position_frames(struct player_t *p, uint64_t *position);
+
+/**
+ * Get the position of the song in frames as it is heard right now.
+ * Compensates for the device's buffer latency and interpolates between
+ * device periods. Convert to seconds with player_get_sample_rate.
+ *
+ * @param p The player structure.
+ * @param position The position in frames.
+ * @return True on success, false otherwise.
+ */
+bool player_get_position(struct player_t *p, uint64_t *position);
+
 /**
  * Get the running length (in seconds) of the current song.
  *
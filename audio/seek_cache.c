@@ -0,0 +1,265 @@
+/* stat's st_mtim and mkdir are hidden by -std=c11 without this. */
+#define _POSIX_C_SOURCE 200809L
+
+#include "seek_cache.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Magic bytes at the start of every cache file. */
+#define SEEK_CACHE_MAGIC "PNSK"
+/* Bump when the cache file layout changes. */
+#define SEEK_CACHE_VERSION 1
+/* Max path length of a cache file. */
+#define SEEK_CACHE_PATH_MAX 4096
+
+/**
+ * Header of a seek table cache file.
+ * Followed by the audio file path and then the seek table data.
+ */
+struct seek_cache_header_t {
+  /* Magic bytes. */
+  char magic[4];
+  /* Cache file layout version. */
+  uint32_t version;
+  /* Size of the audio file. */
+  uint64_t file_size;
+  /* Modification time of the audio file in seconds. */
+  int64_t mtime_sec;
+  /* Modification time of the audio file in nanoseconds. */
+  int64_t mtime_nsec;
+  /* Total PCM frames of the audio. */
+  uint64_t total_frames;
+  /* Size of the seek table data in bytes. */
+  uint64_t data_size;
+  /* Length of the audio file path. */
+  uint32_t path_len;
+  /* Padding. */
+  uint32_t reserved;
+};
+
+/**
+ * FNV-1a hash of the given string.
+ */
+static uint64_t hash_str(const char *str) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (; *str != '\0'; ++str) {
+    hash ^= (unsigned char)*str;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * Create the directory if it does not exist yet.
+ */
+static bool ensure_dir(const char *dir) {
+  if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Get the cache directory, creating it if it does not exist yet.
+ * Uses $XDG_CACHE_HOME/player.nvim/seek, falls back to
+ * $HOME/.cache/player.nvim/seek.
+ */
+static bool cache_dir(char *out, size_t len) {
+  const char *base = getenv("XDG_CACHE_HOME");
+  int written = 0;
+  if (base != NULL && base[0] != '\0') {
+    written = snprintf(out, len, "%s", base);
+  } else {
+    const char *home = getenv("HOME");
+    if (home == NULL || home[0] == '\0') {
+      return false;
+    }
+    written = snprintf(out, len, "%s/.cache", home);
+  }
+  if (written < 0 || (size_t)written >= len || !ensure_dir(out)) {
+    return false;
+  }
+  size_t base_len = (size_t)written;
+  written = snprintf(out + base_len, len - base_len, "/player.nvim");
+  if (written < 0 || (size_t)written >= len - base_len || !ensure_dir(out)) {
+    return false;
+  }
+  base_len += (size_t)written;
+  written = snprintf(out + base_len, len - base_len, "/seek");
+  if (written < 0 || (size_t)written >= len - base_len || !ensure_dir(out)) {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Get the cache file path for the given audio file.
+ */
+static bool cache_path(const char *file_name, char *out, size_t len) {
+  char dir[SEEK_CACHE_PATH_MAX];
+  if (!cache_dir(dir, sizeof(dir))) {
+    return false;
+  }
+  int written = snprintf(out, len, "%s/%016llx.seek", dir,
+                         (unsigned long long)hash_str(file_name));
+  return written >= 0 && (size_t)written < len;
+}
+
+/**
+ * Open the cache entry of the given audio file and check it still matches.
+ * The data size is checked against the size of the cache file, so a
+ * corrupt header never makes the caller allocate more than the file holds.
+ *
+ * @param[in] file_name The audio file.
+ * @param[out] header The header of the entry.
+ * @return The cache file positioned at the seek table data, NULL on a miss.
+ */
+static FILE *open_entry(const char *file_name,
+                        struct seek_cache_header_t *header) {
+  struct stat st;
+  if (stat(file_name, &st) != 0) {
+    return NULL;
+  }
+  char path[SEEK_CACHE_PATH_MAX];
+  if (!cache_path(file_name, path, sizeof(path))) {
+    return NULL;
+  }
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  struct stat cache_st;
+  char *stored_path = NULL;
+  if (fstat(fileno(file), &cache_st) != 0 ||
+      fread(header, sizeof(*header), 1, file) != 1) {
+    goto miss;
+  }
+  // stale or foreign entries are treated as a miss and rebuilt.
+  if (memcmp(header->magic, SEEK_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SEEK_CACHE_VERSION ||
+      header->file_size != (uint64_t)st.st_size ||
+      header->mtime_sec != (int64_t)st.st_mtim.tv_sec ||
+      header->mtime_nsec != (int64_t)st.st_mtim.tv_nsec ||
+      header->path_len != strlen(file_name) || header->data_size == 0) {
+    goto miss;
+  }
+  uint64_t rest = (uint64_t)cache_st.st_size - sizeof(*header);
+  if (header->path_len > rest ||
+      header->data_size != rest - header->path_len) {
+    goto miss;
+  }
+  stored_path = malloc(header->path_len);
+  if (stored_path == NULL ||
+      fread(stored_path, 1, header->path_len, file) != header->path_len ||
+      memcmp(stored_path, file_name, header->path_len) != 0) {
+    goto miss;
+  }
+  free(stored_path);
+  return file;
+
+miss:
+  free(stored_path);
+  fclose(file);
+  return NULL;
+}
+
+/**
+ * Load the cached seek table of the given audio file.
+ */
+bool seek_cache_load(const char *file_name, void **data, size_t *size,
+                     uint64_t *total_frames) {
+  if (file_name == NULL || data == NULL || size == NULL ||
+      total_frames == NULL) {
+    return false;
+  }
+  struct seek_cache_header_t header;
+  FILE *file = open_entry(file_name, &header);
+  if (file == NULL) {
+    return false;
+  }
+  bool result = false;
+  void *buffer = malloc(header.data_size);
+  if (buffer == NULL ||
+      fread(buffer, 1, header.data_size, file) != header.data_size) {
+    goto done;
+  }
+  *data = buffer;
+  *size = header.data_size;
+  *total_frames = header.total_frames;
+  buffer = NULL;
+  result = true;
+
+done:
+  free(buffer);
+  fclose(file);
+  return result;
+}
+
+/**
+ * Get the total PCM frames of a cached entry, without loading its table.
+ */
+bool seek_cache_total_frames(const char *file_name, uint64_t *total_frames) {
+  if (file_name == NULL || total_frames == NULL) {
+    return false;
+  }
+  struct seek_cache_header_t header;
+  FILE *file = open_entry(file_name, &header);
+  if (file == NULL) {
+    return false;
+  }
+  *total_frames = header.total_frames;
+  fclose(file);
+  return true;
+}
+
+/**
+ * Store the seek table of the given audio file in the cache.
+ */
+bool seek_cache_store(const char *file_name, const void *data, size_t size,
+                      uint64_t total_frames) {
+  if (file_name == NULL || data == NULL || size == 0) {
+    return false;
+  }
+  struct stat st;
+  if (stat(file_name, &st) != 0) {
+    return false;
+  }
+  char path[SEEK_CACHE_PATH_MAX];
+  if (!cache_path(file_name, path, sizeof(path))) {
+    return false;
+  }
+  // write to a temp file first so readers never see a partial entry.
+  char tmp_path[SEEK_CACHE_PATH_MAX + 16];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+  FILE *file = fopen(tmp_path, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "failed to open seek cache file: %s\n", tmp_path);
+    return false;
+  }
+  struct seek_cache_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SEEK_CACHE_MAGIC, sizeof(header.magic));
+  header.version = SEEK_CACHE_VERSION;
+  header.file_size = (uint64_t)st.st_size;
+  header.mtime_sec = (int64_t)st.st_mtim.tv_sec;
+  header.mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+  header.total_frames = total_frames;
+  header.data_size = size;
+  header.path_len = (uint32_t)strlen(file_name);
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(file_name, 1, header.path_len, file) == header.path_len &&
+            fwrite(data, 1, size, file) == size;
+  if (fclose(file) != 0) {
+    ok = false;
+  }
+  if (!ok || rename(tmp_path, path) != 0) {
+    fprintf(stderr, "failed to write seek cache file: %s\n", path);
+    unlink(tmp_path);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,45 @@
+#ifndef PLAYER_NVIM_SEEK_CACHE_H
+#define PLAYER_NVIM_SEEK_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Load the cached seek table of the given audio file.
+ * The cache entry is only used when the file's size and modification time
+ * still match the ones it was built from.
+ *
+ * @param[in] file_name The audio file.
+ * @param[out] data Newly allocated seek table data. Free with free().
+ * @param[out] size The size of the seek table data in bytes.
+ * @param[out] total_frames The total PCM frames of the audio.
+ * @return True on a cache hit, false otherwise.
+ */
+bool seek_cache_load(const char *file_name, void **data, size_t *size,
+                     uint64_t *total_frames);
+
+/**
+ * Get the total PCM frames of the given audio file from the cache, without
+ * reading the seek table itself.
+ * The same checks as seek_cache_load decide a hit.
+ *
+ * @param[in] file_name The audio file.
+ * @param[out] total_frames The total PCM frames of the audio.
+ * @return True on a cache hit, false otherwise.
+ */
+bool seek_cache_total_frames(const char *file_name, uint64_t *total_frames);
+
+/**
+ * Store the seek table of the given audio file in the cache.
+ *
+ * @param[in] file_name The audio file.
+ * @param[in] data The seek table data.
+ * @param[in] size The size of the seek table data in bytes.
+ * @param[in] total_frames The total PCM frames of the audio.
+ * @return True on success, false otherwise.
+ */
+bool seek_cache_store(const char *file_name, const void *data, size_t size,
+                      uint64_t total_frames);
+
+#endif
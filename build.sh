@@ -6,17 +6,9 @@ case "$local_os" in
   "Linux")
     local_os="linux"
     ;;
-  "Darwin")
-    local_os="macos"
-    ;;
-  "FreeBSD")
-    local_os="freebsd"
-    ;;
-  "NetBSD")
-    local_os="netbsd"
-    ;;
   *)
-    echo "Platform not supported"
+    # the player relies on futex, eventfd, pidfd and inotify.
+    echo "Platform not supported, only Linux is"
     exit 1
 esac
 
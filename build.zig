@@ -3,6 +3,8 @@ const std = @import("std");
 fn build_audio_lib(b: *std.Build, target: std.Build.ResolvedTarget, optimize: std.builtin.OptimizeMode) *std.Build.Module {
     const files: []const []const u8 = &.{
         "audio/play.c",
+        "audio/dsp.c",
+        "audio/seek_cache.c",
     };
     const flags: []const []const u8 = &.{
         "-Wall",
@@ -28,6 +30,10 @@ fn build_audio_lib(b: *std.Build, target: std.Build.ResolvedTarget, optimize: st
 }
 pub fn build(b: *std.Build) void {
     const target = b.standardTargetOptions(.{});
+    if (target.result.os.tag != .linux) {
+        // futex, eventfd, pidfd, getdents64, statx and inotify are Linux only.
+        @panic("player.nvim only builds for Linux");
+    }
     const optimize = b.standardOptimizeOption(.{});
     const mod = b.addModule("player", .{
         .root_source_file = b.path("src/ffi.zig"),
@@ -86,4 +92,37 @@ pub fn build(b: *std.Build) void {
     });
     exe.linkLibC();
     b.installArtifact(exe);
+
+    // unit tests of the tag reader, the library index, the scanner and the
+    // watcher.
+    const test_step = b.step("test", "Run the unit tests");
+    for ([_][]const u8{ "src/tags.zig", "src/index.zig", "src/scan.zig", "src/watch.zig" }) |file| {
+        const test_mod = b.createModule(.{
+            .target = target,
+            .optimize = optimize,
+            .root_source_file = b.path(file),
+            .link_libc = true,
+        });
+        test_mod.addIncludePath(b.path("./audio/"));
+        test_mod.linkLibrary(audio_lib);
+        const unit_tests = b.addTest(.{
+            .root_module = test_mod,
+        });
+        test_step.dependOn(&b.addRunArtifact(unit_tests).step);
+    }
+
+    // wakeup and spawn latency benchmarks, not installed.
+    const bench_mod = b.createModule(.{
+        .target = target,
+        .optimize = optimize,
+        .root_source_file = b.path("src/bench.zig"),
+        .link_libc = true,
+    });
+    const bench = b.addExecutable(.{
+        .name = "bench",
+        .root_module = bench_mod,
+    });
+    const bench_run = b.addRunArtifact(bench);
+    const bench_step = b.step("bench", "Run the wakeup and spawn latency benchmarks");
+    bench_step.dependOn(&bench_run.step);
 }
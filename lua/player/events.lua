@@ -0,0 +1,152 @@
+local ffi = require("ffi")
+
+-- Event kinds, in the order of the player's EventKind enum.
+local kinds = { "started", "ended", "error", "tick" }
+
+local M = {
+  _poll = nil,
+  _fd = -1,
+  _player_poll = nil,
+  _player_fd = -1,
+  _handlers = {},
+}
+
+-- Register a handler for an event kind.
+--
+-- @param kind "started", "ended", "error", "tick" or "exited".
+-- @param fn Called on the main loop with a table of:
+--    {
+--      kind: String       - The event kind.
+--      playtime: Number   - The playtime in seconds when the event happened.
+--    }
+function M.on(kind, fn)
+  if M._handlers[kind] == nil then
+    M._handlers[kind] = {}
+  end
+  table.insert(M._handlers[kind], fn)
+end
+
+-- Call the handlers of the given event.
+local function dispatch(event)
+  local handlers = M._handlers[event.kind]
+  if handlers == nil then
+    return
+  end
+  for _, fn in ipairs(handlers) do
+    fn(event)
+  end
+end
+
+-- Start watching the player's event fd.
+-- Does nothing if the fd is already watched, so it can be called again
+-- whenever the player may have reconnected.
+--
+-- @param player The player interface.
+-- @return true if events are delivered, false if the player has no event fd.
+function M.start(player)
+  local fd = player.get_event_fd()
+  if M._poll ~= nil and fd == M._fd then
+    return true
+  end
+  M.stop()
+  if fd < 0 then
+    return false
+  end
+  local poll = vim.uv.new_poll(fd)
+  if poll == nil then
+    return false
+  end
+  local event = ffi.new("player_event_t")
+  poll:start("r", function(err)
+    if err ~= nil then
+      return
+    end
+    -- drain everything now, the fd is only readable again on new events.
+    local pending = {}
+    local result = player.next_event(event)
+    while result > 0 do
+      local kind = kinds[event.kind]
+      if kind ~= nil then
+        local playtime = 0
+        if event.sample_rate > 0 then
+          playtime = tonumber(event.frames) / event.sample_rate
+        end
+        table.insert(pending, { kind = kind, playtime = playtime })
+      end
+      result = player.next_event(event)
+    end
+    if result < 0 then
+      -- the fd will not deliver anymore, stop before it spins.
+      M.stop()
+    end
+    if #pending > 0 then
+      vim.schedule(function()
+        for _, e in ipairs(pending) do
+          dispatch(e)
+        end
+      end)
+    end
+  end)
+  M._poll = poll
+  M._fd = fd
+  return true
+end
+
+-- Stop watching the player's event fd.
+function M.stop()
+  if M._poll ~= nil then
+    M._poll:stop()
+    M._poll:close()
+    M._poll = nil
+    M._fd = -1
+  end
+end
+
+-- Stop watching the player process.
+function M.unwatch_player()
+  if M._player_poll ~= nil then
+    M._player_poll:stop()
+    M._player_poll:close()
+    M._player_poll = nil
+    M._player_fd = -1
+  end
+end
+
+-- Watch the player process, dispatching "exited" the moment it exits.
+-- Does nothing if the process is already watched.
+--
+-- @param player The player interface.
+function M.watch_player(player)
+  local fd = player.get_player_fd()
+  if M._player_poll ~= nil and fd == M._player_fd then
+    return
+  end
+  M.unwatch_player()
+  if fd < 0 then
+    return
+  end
+  local poll = vim.uv.new_poll(fd)
+  if poll == nil then
+    return
+  end
+  poll:start("r", function()
+    -- player_exited closes the fd, stop polling it first.
+    M.unwatch_player()
+    if player.player_exited() ~= 0 then
+      vim.schedule(function()
+        dispatch({ kind = "exited", playtime = 0 })
+      end)
+    else
+      M.watch_player(player)
+    end
+  end)
+  M._player_poll = poll
+  M._player_fd = fd
+end
+
+-- Flag of events being delivered.
+function M.active()
+  return M._poll ~= nil
+end
+
+return M
@@ -1,9 +1,12 @@
 local ui = require("player.ui")
 local utils = require("player.utils")
+local state = require("player.state")
 
 local M = {
   -- file select options
-  options = nil
+  options = nil,
+  -- index into options by full path
+  rows = {},
 }
 
 -- window specifics
@@ -22,25 +25,36 @@ function M.select_file()
   if M.options ~= nil then
     -- minus 1 to account for the offset with the instructions
     local info = M.options[idx - 1]
-    require("player").play(info.full_path)
+    if info then
+      require("player").play(info.full_path)
+    end
   end
 end
 
+local instruction_text = "<ENTER> to play file"
+local error_text = "--- No Audio Files Found ---"
+
+-- Get the lines shown when no audio files were found.
+local function empty_contents()
+  return {
+    " ",
+    utils.get_center_padding(error_text, width, " ") .. error_text,
+  }
+end
+
 -- Format the list of audio files.
+-- Walks the directory synchronously, used when the scanner is unavailable.
 function M.format_contents(dir, recursive)
   M.options = {}
+  M.rows = {}
   local content = {}
   -- TODO maybe categorize songs in nice format?
   local files = utils.get_files(dir, recursive)
 
-  local error_text = "--- No Audio Files Found ---"
   if vim.tbl_isempty(files) then
-    table.insert(content, " ")
-    table.insert(content, utils.get_center_padding(error_text, width, " ") .. error_text)
-    return content
+    return empty_contents()
   end
 
-  local instruction_text = "<ENTER> to play file"
   table.insert(content, utils.get_center_padding(instruction_text, width, " ") .. instruction_text)
 
   for _, file in ipairs(files) do
@@ -49,15 +63,210 @@ function M.format_contents(dir, recursive)
       name = utils.get_basename(file),
     }
     table.insert(M.options, info)
+    M.rows[file] = #M.options
     table.insert(content, info.name)
   end
 
   return content
 end
 
+-- Append a batch of scanned audio files to the window.
+--
+-- @param bufnr The buffer the scan was started for.
+-- @param files The full paths of the audio files.
+local function append_files(bufnr, files)
+  if bufnr ~= tracker_bufnr then
+    return
+  end
+  local lines = {}
+  for _, file in ipairs(files) do
+    local info = {
+      full_path = file,
+      name = utils.get_basename(file),
+    }
+    table.insert(M.options, info)
+    M.rows[file] = #M.options
+    table.insert(lines, info.name)
+  end
+  vim.api.nvim_buf_set_lines(bufnr, -1, -1, false, lines)
+end
+
+-- Get the row of a library file, its tags if it has them.
+local function library_row(file)
+  local row = file.name
+  if file.title ~= "" then
+    row = file.title
+    if file.artist ~= "" then
+      row = file.artist .. " - " .. file.title
+    end
+  end
+  if file.duration > 0 then
+    local time = utils.extract_time_info(file.duration)
+    row = row .. string.format(" [%d:%02d]", math.floor(time.min), math.floor(time.sec))
+  end
+  return row
+end
+
+-- Show the files of the library index in the window.
+--
+-- @param bufnr The buffer of the window.
+-- @param files The files, see state.library.
+local function show_library(bufnr, files)
+  M.options = {}
+  M.rows = {}
+  if vim.tbl_isempty(files) then
+    vim.api.nvim_buf_set_lines(bufnr, 0, -1, false, empty_contents())
+    return
+  end
+  local content = { utils.get_center_padding(instruction_text, width, " ") .. instruction_text }
+  for _, file in ipairs(files) do
+    local info = {
+      full_path = file.path,
+      name = library_row(file),
+    }
+    table.insert(M.options, info)
+    M.rows[file.path] = #M.options
+    table.insert(content, info.name)
+  end
+  vim.api.nvim_buf_set_lines(bufnr, 0, -1, false, content)
+end
+
+-- Drop the rows removed by a batch of changes, from the first one on.
+-- Removed rows are left as false until then, so the rows after them keep
+-- their index during the batch.
+--
+-- @param bufnr The buffer of the window.
+-- @param first The first removed row.
+local function compact_rows(bufnr, first)
+  local kept = {}
+  local lines = {}
+  for i = first, #M.options do
+    local info = M.options[i]
+    if info then
+      table.insert(kept, info)
+      table.insert(lines, info.name)
+    end
+    M.options[i] = nil
+  end
+  for _, info in ipairs(kept) do
+    table.insert(M.options, info)
+    M.rows[info.full_path] = #M.options
+  end
+  -- options[i] is on line i, line 0 is the header.
+  vim.api.nvim_buf_set_lines(bufnr, first, -1, false, lines)
+end
+
+-- Apply library changes to the rows of the window, leaving the others as
+-- they are.
+--
+-- @param changes The changes, see state.on_library_change.
+local function apply_changes(changes)
+  local bufnr = tracker_bufnr
+  if bufnr == nil or M.options == nil then
+    return
+  end
+  local first_removed = nil
+  for _, change in ipairs(changes) do
+    -- options[i] is on line i, line 0 is the header.
+    local row = M.rows[change.path]
+    if change.op == "-" then
+      if row ~= nil then
+        M.options[row] = false
+        M.rows[change.path] = nil
+        if first_removed == nil or row < first_removed then
+          first_removed = row
+        end
+      end
+    else
+      local info = {
+        full_path = change.path,
+        name = library_row(change.file),
+      }
+      if row ~= nil then
+        M.options[row] = info
+        vim.api.nvim_buf_set_lines(bufnr, row, row + 1, false, { info.name })
+      else
+        if #M.options == 0 then
+          local header = { utils.get_center_padding(instruction_text, width, " ") .. instruction_text }
+          vim.api.nvim_buf_set_lines(bufnr, 0, -1, false, header)
+        end
+        table.insert(M.options, info)
+        M.rows[change.path] = #M.options
+        vim.api.nvim_buf_set_lines(bufnr, -1, -1, false, { info.name })
+      end
+    end
+  end
+  if first_removed ~= nil then
+    compact_rows(bufnr, first_removed)
+  end
+  if vim.tbl_isempty(M.options) then
+    vim.api.nvim_buf_set_lines(bufnr, 0, -1, false, empty_contents())
+  end
+end
+
+state.on_library_change(apply_changes)
+
+-- Finish the scan of the window.
+-- Shows the new library index if the scan changed it.
+--
+-- @param bufnr The buffer the scan was started for.
+-- @param opts The plugin options.
+local function scan_done(bufnr, opts)
+  if bufnr ~= tracker_bufnr then
+    return
+  end
+  -- the first scan wrote the index the watcher needs.
+  state.watch_library()
+  if state.scan_changed() then
+    local files = state.library(opts.parent_dir, opts.recursive)
+    if files ~= nil then
+      show_library(bufnr, files)
+      return
+    end
+  end
+  if vim.tbl_isempty(M.options) then
+    vim.api.nvim_buf_set_lines(bufnr, 0, -1, false, empty_contents())
+  end
+end
+
+-- Fill the window with the audio files of the directory.
+-- Shows the library index of the last scan right away, then rescans the
+-- directories that changed in the background. Without an index the files
+-- show up as they are found. Falls back to a synchronous walk if the
+-- scanner can not start.
+--
+-- @param bufnr The buffer of the window.
+-- @param opts The plugin options.
+local function fill_contents(bufnr, opts)
+  local library = state.library(opts.parent_dir, opts.recursive)
+  if library ~= nil then
+    show_library(bufnr, library)
+  else
+    M.options = {}
+    M.rows = {}
+    local header = { utils.get_center_padding(instruction_text, width, " ") .. instruction_text }
+    vim.api.nvim_buf_set_lines(bufnr, 0, -1, false, header)
+  end
+  local started = state.scan(
+    opts.parent_dir,
+    opts.recursive,
+    function(files)
+      append_files(bufnr, files)
+    end,
+    function()
+      scan_done(bufnr, opts)
+    end
+  )
+  if not started and library == nil then
+    local contents = M.format_contents(opts.parent_dir, opts.recursive)
+    vim.api.nvim_buf_set_lines(bufnr, 0, -1, false, contents)
+  end
+end
+
 -- Close the window if it exists.
 function M.close()
   if tracker_win_id ~= nil then
+    state.cancel_scan()
     vim.api.nvim_win_close(tracker_win_id, true)
     tracker_win_id = nil
     tracker_bufnr = nil
@@ -67,6 +276,7 @@ end
 -- Toggle the player file select window on or off.
 function M.toggle_window(opts)
   if tracker_win_id ~= nil then
+    state.cancel_scan()
     vim.api.nvim_win_close(tracker_win_id, true)
     tracker_win_id = nil
     tracker_bufnr = nil
@@ -77,10 +287,6 @@ function M.toggle_window(opts)
     height = win_height
   end
   local window = ui.create_window("File Select", "player_file_viewer.nvim.window", width, height, 1)
-  local contents = M.format_contents(opts.parent_dir, opts.recursive)
-  if contents == nil then
-    contents = {}
-  end
   tracker_win_id = window.win_id
   tracker_bufnr = window.bufnr
   vim.api.nvim_buf_set_keymap(
@@ -104,7 +310,7 @@ function M.toggle_window(opts)
     "<Cmd>lua require('player.file_ui').select_file()<CR>",
     { silent = true }
   )
-  vim.api.nvim_buf_set_lines(tracker_bufnr, 0, #contents, false, contents)
+  fill_contents(tracker_bufnr, opts)
   vim.api.nvim_set_option_value(
     "readonly",
     true,
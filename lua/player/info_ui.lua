@@ -13,6 +13,26 @@ local height = 4
 -- 1 second
 local timer_delay = 1000
 
+-- flag of the redraw handlers being registered with the player events.
+local watching = false
+
+-- redraw the player on player events if it is displayed.
+local function watch_events(state)
+  if watching then
+    return
+  end
+  watching = true
+  local redraw = function()
+    if tracker_bufnr ~= nil then
+      M.draw_player(state.get_player_info())
+    end
+  end
+  state.on("started", redraw)
+  state.on("ended", redraw)
+  state.on("tick", redraw)
+  state.on("exited", redraw)
+end
+
 -- timer function to update the player if it is displayed
 local function timer_fn(state)
   return function ()
@@ -179,7 +199,11 @@ function M.toggle_window(state, live_update)
     { buf = tracker_bufnr }
   )
   if live_update then
-    vim.defer_fn(timer_fn(state), timer_delay)
+    if state.has_events() then
+      watch_events(state)
+    else
+      vim.defer_fn(timer_fn(state), timer_delay)
+    end
   end
 end
 
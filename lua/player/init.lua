@@ -10,6 +10,10 @@ local M = {
     volume_scale = 5,
     live_update = true,
     recursive = false,
+    watch = true,
+    mode = "process",
+    tick_ms = 1000,
+    prespawn = false,
   },
   is_setup = false
 }
@@ -29,7 +33,7 @@ function M.setup(opts)
   vim.api.nvim_create_autocmd("VimLeavePre", {
     group = player_autogroup,
     callback = function()
-      M.kill()
+      state.deinit()
     end
   })
   local result = state.setup(M.opts)
@@ -37,6 +41,20 @@ function M.setup(opts)
     utils.error("player setup failed: code(" .. result .. ")")
   end
   M.is_setup = true
+  if result == 0 then
+    if M.opts.prespawn == "setup" then
+      state.prespawn()
+    elseif M.opts.prespawn == "idle" then
+      -- the first moment the user stops typing.
+      vim.api.nvim_create_autocmd({ "CursorHold", "CursorHoldI" }, {
+        group = player_autogroup,
+        once = true,
+        callback = function()
+          state.prespawn()
+        end
+      })
+    end
+  end
 end
 
 -- Toggle the player info window.
@@ -69,6 +87,24 @@ function M.play(name)
   state.play(name)
 end
 
+-- Enqueue the given song file to play once the current song ends.
+--
+-- @param name The song file name.
+function M.enqueue(name)
+  if not M.is_setup then
+    M.setup()
+  end
+  state.enqueue(name)
+end
+
+-- Register a handler for player events.
+--
+-- @param kind "started", "ended", "error", "tick" or "exited".
+-- @param fn Called with { kind, playtime } on the main loop.
+function M.on(kind, fn)
+  state.on(kind, fn)
+end
+
 -- Get the current volume.
 function M.get_volume()
   return state.volume()
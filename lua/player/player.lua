@@ -1,20 +1,277 @@
 local ffi = require("ffi")
 
+-- libplayer_nvim.so, controls a separate player process.
 ffi.cdef [[
+typedef struct {
+  uint64_t frames;
+  uint64_t length;
+  uint32_t sample_rate;
+  uint8_t is_playing;
+  uint8_t in_progress;
+  uint16_t reserved;
+} player_status_t;
+int get_status(player_status_t *out);
+typedef struct {
+  uint8_t kind;
+  uint8_t reserved[3];
+  uint32_t sample_rate;
+  uint64_t frames;
+} player_event_t;
+int get_event_fd();
+int next_event(player_event_t *out);
+void set_tick(uint32_t ms);
 int setup(const char *root_dir);
+int setup_shared(const char *root_dir);
+int prespawn();
 int play(const char *file_name);
+int enqueue(const char *file_name);
 int is_playing();
 int in_progress();
 void set_volume(float vol);
 double get_playtime();
 long int get_audio_length();
-void pause();
-void resume();
-void stop();
+int pause();
+int resume();
+int stop();
+void kill_player();
+int get_player_fd();
+int player_exited();
 void deinit();
+int scan_start(const char *root, int recursive);
+int scan_fd();
+const char *scan_take();
+int scan_done();
+void scan_cancel();
+int scan_changed();
+typedef struct {
+  const char *path;
+  const char *title;
+  const char *artist;
+  const char *album;
+  uint32_t path_len;
+  uint32_t name_offset;
+  uint32_t title_len;
+  uint32_t artist_len;
+  uint32_t album_len;
+  uint32_t duration_ms;
+  uint8_t format;
+  uint8_t reserved[7];
+} library_entry_t;
+int library_open(const char *root, int recursive);
+int library_entry(int i, library_entry_t *out);
+void library_close();
+int watch_start(const char *root, int recursive);
+int watch_fd();
+const char *watch_take();
+void watch_stop();
+]]
+
+-- libplayer.so, the audio engine itself.
+-- Renamed on the Lua side so they do not clash with the functions above.
+ffi.cdef [[
+int inproc_setup(void *cb) __asm__("setup");
+int inproc_play(const char *file_name) __asm__("play");
+int inproc_enqueue_next(const char *file_name) __asm__("enqueue_next");
+int inproc_is_playing() __asm__("is_playing");
+int inproc_in_progress() __asm__("in_progress");
+void inproc_set_volume(float vol) __asm__("set_volume");
+uint64_t inproc_get_position() __asm__("get_position");
+uint32_t inproc_get_sample_rate() __asm__("get_sample_rate");
+uint64_t inproc_get_audio_length() __asm__("get_audio_length");
+void inproc_pause() __asm__("pause");
+void inproc_resume() __asm__("resume");
+int inproc_stop() __asm__("stop");
+void inproc_deinit() __asm__("deinit");
+int inproc_scan_start(const char *root, int recursive) __asm__("scan_start");
+int inproc_scan_fd() __asm__("scan_fd");
+const char *inproc_scan_take() __asm__("scan_take");
+int inproc_scan_done() __asm__("scan_done");
+void inproc_scan_cancel() __asm__("scan_cancel");
+int inproc_scan_changed() __asm__("scan_changed");
+int inproc_library_open(const char *root, int recursive) __asm__("library_open");
+int inproc_library_entry(int i, library_entry_t *out) __asm__("library_entry");
+void inproc_library_close() __asm__("library_close");
+int inproc_watch_start(const char *root, int recursive) __asm__("watch_start");
+int inproc_watch_fd() __asm__("watch_fd");
+const char *inproc_watch_take() __asm__("watch_take");
+void inproc_watch_stop() __asm__("watch_stop");
 ]]
 
 local dirname = string.sub(debug.getinfo(1).source, 2, string.len('/player.lua') * -1)
-local library_path = dirname .. '../../zig-out/lib/libplayer_nvim.so'
-local lib = ffi.load(library_path)
-return lib
+
+local M = {}
+
+-- Wrap libplayer_nvim.so, adding a status snapshot as a Lua table.
+--
+-- @param lib The loaded libplayer_nvim.so.
+-- @param shared Flag to use the shared audio daemon.
+-- @return The player interface.
+local function out_of_process(lib, shared)
+  local status = ffi.new("player_status_t")
+  return setmetatable({
+    setup = function(root_dir)
+      if shared then
+        return lib.setup_shared(root_dir)
+      end
+      return lib.setup(root_dir)
+    end,
+    get_status = function()
+      lib.get_status(status)
+      return {
+        frames = tonumber(status.frames),
+        sample_rate = tonumber(status.sample_rate),
+        length = tonumber(status.length),
+        is_playing = status.is_playing,
+        in_progress = status.in_progress,
+      }
+    end,
+  }, { __index = lib })
+end
+
+-- Wrap libplayer.so in the same interface as libplayer_nvim.so.
+--
+-- @param lib The loaded libplayer.so.
+-- @return The player interface.
+local function in_process(lib)
+  return {
+    setup = function(_)
+      if lib.inproc_setup(nil) == 0 then
+        return -1
+      end
+      return 0
+    end,
+    play = function(file_name)
+      if lib.inproc_play(file_name) == 0 then
+        return -1
+      end
+      return 0
+    end,
+    enqueue = function(file_name)
+      if lib.inproc_enqueue_next(file_name) == 0 then
+        return -1
+      end
+      return 0
+    end,
+    is_playing = function()
+      return lib.inproc_is_playing()
+    end,
+    in_progress = function()
+      return lib.inproc_in_progress()
+    end,
+    set_volume = function(vol)
+      lib.inproc_set_volume(vol)
+    end,
+    get_playtime = function()
+      local sample_rate = tonumber(lib.inproc_get_sample_rate())
+      if sample_rate == 0 then
+        return 0
+      end
+      return tonumber(lib.inproc_get_position()) / sample_rate
+    end,
+    get_audio_length = function()
+      return tonumber(lib.inproc_get_audio_length())
+    end,
+    get_status = function()
+      return {
+        frames = tonumber(lib.inproc_get_position()),
+        sample_rate = tonumber(lib.inproc_get_sample_rate()),
+        length = tonumber(lib.inproc_get_audio_length()),
+        is_playing = lib.inproc_is_playing(),
+        in_progress = lib.inproc_in_progress(),
+      }
+    end,
+    pause = function()
+      lib.inproc_pause()
+      return 0
+    end,
+    resume = function()
+      lib.inproc_resume()
+      return 0
+    end,
+    stop = function()
+      if lib.inproc_stop() == 0 then
+        return -1
+      end
+      return 0
+    end,
+    deinit = function()
+      lib.inproc_deinit()
+    end,
+    -- no player process to signal events, callers fall back to polling.
+    get_event_fd = function()
+      return -1
+    end,
+    next_event = function(_)
+      return 0
+    end,
+    set_tick = function(_) end,
+    kill_player = function()
+      lib.inproc_stop()
+    end,
+    -- no player process to watch.
+    get_player_fd = function()
+      return -1
+    end,
+    player_exited = function()
+      return 0
+    end,
+    -- setup already opened the audio device.
+    prespawn = function()
+      return 0
+    end,
+    scan_start = function(root, recursive)
+      return lib.inproc_scan_start(root, recursive)
+    end,
+    scan_fd = function()
+      return lib.inproc_scan_fd()
+    end,
+    scan_take = function()
+      return lib.inproc_scan_take()
+    end,
+    scan_done = function()
+      return lib.inproc_scan_done()
+    end,
+    scan_cancel = function()
+      lib.inproc_scan_cancel()
+    end,
+    scan_changed = function()
+      return lib.inproc_scan_changed()
+    end,
+    library_open = function(root, recursive)
+      return lib.inproc_library_open(root, recursive)
+    end,
+    library_entry = function(i, out)
+      return lib.inproc_library_entry(i, out)
+    end,
+    library_close = function()
+      lib.inproc_library_close()
+    end,
+    watch_start = function(root, recursive)
+      return lib.inproc_watch_start(root, recursive)
+    end,
+    watch_fd = function()
+      return lib.inproc_watch_fd()
+    end,
+    watch_take = function()
+      return lib.inproc_watch_take()
+    end,
+    watch_stop = function()
+      lib.inproc_watch_stop()
+    end,
+  }
+end
+
+-- Load the player library.
+--
+-- @param mode "process" to play audio in a separate player process,
+--  "shared" to play audio in one daemon shared by every neovim instance,
+--  "inprocess" to play audio inside neovim itself.
+-- @return The player interface.
+function M.load(mode)
+  if mode == "inprocess" then
+    return in_process(ffi.load(dirname .. '../../zig-out/lib/libplayer.so'))
+  end
+  return out_of_process(ffi.load(dirname .. '../../zig-out/lib/libplayer_nvim.so'), mode == "shared")
+end
+
+return M
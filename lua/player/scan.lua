@@ -0,0 +1,112 @@
+local ffi = require("ffi")
+
+local M = {
+  _poll = nil,
+  -- bumped on every scan, so late batches of an older scan are dropped.
+  _generation = 0,
+}
+
+-- Stop delivering the results of the running scan.
+function M.stop()
+  if M._poll ~= nil then
+    M._poll:stop()
+    M._poll:close()
+    M._poll = nil
+  end
+end
+
+-- Scan a directory for audio files on the player's scanner threads.
+-- Results arrive in batches on the main loop, so input never blocks.
+-- Starting a scan cancels the previous one.
+--
+-- @param player The player interface.
+-- @param dir The directory to scan.
+-- @param recursive Flag to scan sub directories too.
+-- @param on_batch Called with a list of full paths of audio files.
+-- @param on_done Called once the scan finished.
+-- @return true if the scan started, false otherwise.
+function M.start(player, dir, recursive, on_batch, on_done)
+  M.stop()
+  M._generation = M._generation + 1
+  local generation = M._generation
+  if player.scan_start(dir, recursive and 1 or 0) ~= 0 then
+    return false
+  end
+  local poll = vim.uv.new_poll(player.scan_fd())
+  if poll == nil then
+    player.scan_cancel()
+    return false
+  end
+  poll:start("r", function(err)
+    if err ~= nil then
+      return
+    end
+    -- read the flag first, once done every path is already pending.
+    local done = player.scan_done() ~= 0
+    -- take everything pending, the fd is cleared once nothing is left.
+    local paths = {}
+    local batch = player.scan_take()
+    while batch ~= nil do
+      for path in string.gmatch(ffi.string(batch), "[^\n]+") do
+        table.insert(paths, path)
+      end
+      batch = player.scan_take()
+    end
+    if done then
+      M.stop()
+    end
+    vim.schedule(function()
+      if generation ~= M._generation then
+        return
+      end
+      if #paths > 0 then
+        on_batch(paths)
+      end
+      if done then
+        on_done()
+      end
+    end)
+  end)
+  M._poll = poll
+  return true
+end
+
+-- Read the library index of a directory, written by its last finished scan.
+-- Costs a single mmap of the index instead of a walk of the directory.
+--
+-- @param player The player interface.
+-- @param dir The scanned directory.
+-- @param recursive Flag of sub directories being scanned.
+-- @return List of files, nil if the directory has no index yet.
+--    {
+--      path: String       - The full path.
+--      name: String       - The file name.
+--      title: String      - The title tag, empty if unknown.
+--      artist: String     - The artist tag, empty if unknown.
+--      album: String      - The album tag, empty if unknown.
+--      duration: Number   - The duration in seconds, 0 if unknown.
+--    }
+function M.library(player, dir, recursive)
+  local count = player.library_open(dir, recursive and 1 or 0)
+  if count < 0 then
+    return nil
+  end
+  local entry = ffi.new("library_entry_t")
+  local files = {}
+  for i = 0, count - 1 do
+    if player.library_entry(i, entry) == 0 then
+      table.insert(files, {
+        path = ffi.string(entry.path, entry.path_len),
+        name = ffi.string(entry.path + entry.name_offset, entry.path_len - entry.name_offset),
+        title = ffi.string(entry.title, entry.title_len),
+        artist = ffi.string(entry.artist, entry.artist_len),
+        album = ffi.string(entry.album, entry.album_len),
+        duration = entry.duration_ms / 1000,
+      })
+    end
+  end
+  player.library_close()
+  return files
+end
+
+return M
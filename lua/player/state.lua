@@ -1,5 +1,8 @@
-local player = require("player.player")
+local loader = require("player.player")
+local events = require("player.events")
+local scan = require("player.scan")
 local utils = require("player.utils")
+local watch = require("player.watch")
 local str = require("player.str");
 
 local dirname = string.sub(debug.getinfo(1).source, 2, string.len('/state.lua') * -1)
@@ -8,15 +11,109 @@ local M = {
   _song = nil,
   _volume = 75,
   _started = nil,
+  -- handlers of library changes, see on_library_change.
+  _library_handlers = {},
   opts = {
     parent_dir = vim.env.HOME,
+    mode = "process",
+    tick_ms = 1000,
   }
 }
 
+-- the player library, replaced on setup when another mode is configured.
+local player = loader.load("process")
+
 -- Initial setup of the player.
 function M.setup(opts)
   M.opts = opts
-  return player.setup(dirname)
+  if opts.mode ~= "process" then
+    player = loader.load(opts.mode)
+  end
+  local result = player.setup(dirname)
+  if result == 0 then
+    player.set_volume(M._volume / 100)
+    player.set_tick(opts.tick_ms or 0)
+    events.start(player)
+    events.on("exited", function()
+      utils.error("the player process exited")
+    end)
+    M.watch_library()
+  end
+  return result
+end
+
+-- Start the player ahead of the first play, so the first play only waits
+-- for the song to open.
+function M.prespawn()
+  if player.prespawn() ~= 0 then
+    utils.error("failed to start the player")
+  end
+  events.start(player)
+  events.watch_player(player)
+end
+
+-- Register a handler for player events.
+--
+-- @param kind "started", "ended", "error", "tick" or "exited".
+-- @param fn The handler, see events.on.
+function M.on(kind, fn)
+  events.on(kind, fn)
+end
+
+-- Flag of player events being delivered.
+-- Without events, callers have to poll the player themselves.
+function M.has_events()
+  return events.active()
+end
+
+-- Scan a directory for audio files without blocking the editor.
+--
+-- @param dir The directory to scan.
+-- @param recursive Flag to scan sub directories too.
+-- @param on_batch Called with each list of full paths found.
+-- @param on_done Called once the scan finished.
+-- @return true if the scan started, false otherwise.
+function M.scan(dir, recursive, on_batch, on_done)
+  return scan.start(player, dir, recursive, on_batch, on_done)
+end
+
+-- Get the flag for the finished scan having changed the library index.
+function M.scan_changed()
+  return player.scan_changed() ~= 0
+end
+
+-- Read the library index of a directory, see scan.library.
+--
+-- @return List of files, nil if the directory was never scanned.
+function M.library(dir, recursive)
+  return scan.library(player, dir, recursive)
+end
+
+-- Cancel the running scan, its remaining results are dropped.
+function M.cancel_scan()
+  scan.stop()
+  player.scan_cancel()
+end
+
+-- Watch the library of the parent directory for changed files.
+-- Does nothing if watching is turned off, or the directory was never
+-- scanned.
+function M.watch_library()
+  if not M.opts.watch or watch.active() then
+    return
+  end
+  watch.start(player, M.opts.parent_dir, M.opts.recursive, function(changes)
+    for _, fn in ipairs(M._library_handlers) do
+      fn(changes)
+    end
+  end)
+end
+
+-- Register a handler for library changes.
+--
+-- @param fn Called with the list of changes, see watch.start.
+function M.on_library_change(fn)
+  table.insert(M._library_handlers, fn)
 end
 
 -- Get the version of the library.
@@ -75,6 +172,25 @@ function M.play(name)
     if player.play(M._song) ~= 0 then
       utils.error("failed to play song")
     end
+    -- the shared daemon may have been restarted with a new socket.
+    events.start(player)
+    events.watch_player(player)
+  end
+end
+
+-- Enqueue the given song to play once the current one ends.
+function M.enqueue(name)
+  local file_name = name
+  if not string.find(name, M.opts.parent_dir, 1, true) then
+    file_name = str.path_join(M.opts.parent_dir, name)
+  end
+  if file_name ~= nil then
+    utils.info("enqueued: " .. file_name)
+    if player.enqueue(file_name) ~= 0 then
+      utils.error("failed to enqueue song")
+    end
+    events.start(player)
+    events.watch_player(player)
   end
 end
 
@@ -114,35 +230,59 @@ end
 --      audio_length: Number - The full length of the audio.
 --    }
 function M.get_player_info()
-  if M.in_progress() == 0 then
+  -- one snapshot, so the fields always belong to the same moment.
+  local status = player.get_status()
+  if status.in_progress == 0 then
     return nil
   end
+  local playtime = 0
+  if status.sample_rate > 0 then
+    playtime = status.frames / status.sample_rate
+  end
   return {
     song = M.song(),
     volume = M.volume(),
-    playtime = M.get_playtime(),
-    audio_length = M.audio_length(),
-    is_playing = M.is_playing(),
+    playtime = playtime,
+    audio_length = status.length,
+    is_playing = status.is_playing,
   }
 end
 
 -- Pause the player.
 function M.pause()
-  player.pause()
+  if player.pause() ~= 0 then
+    utils.error("failed to pause: the player is not responding")
+  end
 end
 
 -- Resume the player.
 function M.resume()
-  player.resume()
+  if player.resume() ~= 0 then
+    utils.error("failed to resume: the player is not responding")
+  end
 end
 
 -- Stop the player.
 function M.stop()
-  player.stop()
+  if player.stop() ~= 0 then
+    utils.error("failed to stop: the player is not responding")
+  end
 end
 
--- Kill the player.
+-- Kill the player process without waiting for it.
+-- The next play starts a new one.
 function M.kill()
+  events.unwatch_player()
+  player.kill_player()
+end
+
+-- Tear down the player on exit.
+function M.deinit()
+  M.cancel_scan()
+  watch.stop()
+  player.watch_stop()
+  events.stop()
+  events.unwatch_player()
   player.deinit()
 end
 
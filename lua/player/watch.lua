@@ -0,0 +1,113 @@
+local ffi = require("ffi")
+
+local M = {
+  _poll = nil,
+  -- bumped on every start, so late changes of an older watcher are dropped.
+  _generation = 0,
+}
+
+-- Flag of the library being watched.
+function M.active()
+  return M._poll ~= nil
+end
+
+-- Stop delivering library changes.
+function M.stop()
+  if M._poll ~= nil then
+    M._poll:stop()
+    M._poll:close()
+    M._poll = nil
+  end
+end
+
+-- Get the file name of a path.
+local function basename(path)
+  return string.match(path, "[^/]*$")
+end
+
+-- Parse one change line of the watcher, see watch_take.
+local function parse(line)
+  local op = string.sub(line, 1, 1)
+  if op == "-" then
+    return { op = "-", path = string.sub(line, 2) }
+  end
+  if op ~= "+" then
+    return nil
+  end
+  local path, title, artist, album, duration_ms =
+    string.match(string.sub(line, 2), "^(.*)\t([^\t]*)\t([^\t]*)\t([^\t]*)\t(%d+)$")
+  if path == nil then
+    return nil
+  end
+  return {
+    op = "+",
+    path = path,
+    file = {
+      path = path,
+      name = basename(path),
+      title = title,
+      artist = artist,
+      album = album,
+      duration = tonumber(duration_ms) / 1000,
+    },
+  }
+end
+
+-- Keep the library index of a directory current while files change.
+-- Needs the index of a finished scan. Starting a watcher stops the previous
+-- one.
+--
+-- @param player The player interface.
+-- @param dir The scanned directory.
+-- @param recursive Flag of sub directories being scanned.
+-- @param on_change Called on the main loop with the list of changes, in the
+--  order they happened.
+--    {
+--      op: String    - "+" for an added or changed file, "-" for a removed one.
+--      path: String  - The full path.
+--      file: Table   - The file for "+", see scan.library.
+--    }
+-- @return true if the watcher started, false otherwise.
+function M.start(player, dir, recursive, on_change)
+  M.stop()
+  M._generation = M._generation + 1
+  local generation = M._generation
+  if player.watch_start(dir, recursive and 1 or 0) ~= 0 then
+    return false
+  end
+  local poll = vim.uv.new_poll(player.watch_fd())
+  if poll == nil then
+    player.watch_stop()
+    return false
+  end
+  poll:start("r", function(err)
+    if err ~= nil then
+      return
+    end
+    -- take everything pending, the fd is cleared once nothing is left.
+    local changes = {}
+    local batch = player.watch_take()
+    while batch ~= nil do
+      for line in string.gmatch(ffi.string(batch), "[^\n]+") do
+        local change = parse(line)
+        if change ~= nil then
+          table.insert(changes, change)
+        end
+      end
+      batch = player.watch_take()
+    end
+    if #changes == 0 then
+      return
+    end
+    vim.schedule(function()
+      if generation ~= M._generation then
+        return
+      end
+      on_change(changes)
+    end)
+  end)
+  M._poll = poll
+  return true
+end
+
+return M
@@ -0,0 +1,196 @@
+//! Benchmarks of the plugin's process plumbing.
+//!
+//! Wakeup latency of the player process, from a command being posted to
+//! the sleeping consumer running again. Compares the futex word in the
+//! shared memory against the named POSIX semaphore it replaced.
+//!
+//! Spawn latency of a child process against the resident size of the
+//! parent. Compares fork/exec through std.process.Child against
+//! posix_spawn, the way a large neovim starts the player.
+//!
+//! Run with `zig build bench -Doptimize=ReleaseFast`.
+const std = @import("std");
+const common = @import("common.zig");
+const spawn = @import("spawn.zig");
+
+/// Wakeups measured per run.
+const iterations: usize = 2000;
+/// Time the waker gives the consumer to actually fall asleep, in ns.
+const settle_ns: u64 = 50 * std.time.ns_per_us;
+/// Spawns measured per method and parent size.
+const spawn_iterations: usize = 20;
+/// Resident sizes the parent grows to for the spawn runs, in MiB.
+const spawn_rss_mib = [_]usize{ 0, 256, 1024, 2048 };
+/// The child of the spawn runs, exits right away.
+const spawn_exe = "/bin/true";
+/// Semaphore name for the comparison run.
+const bench_sem_name: [*:0]const u8 = "/jmatth11.player.nvim.bench.sem";
+
+/// State shared between the waker and the consumer thread.
+const Shared = struct {
+    /// Base of the timestamps.
+    base: std.time.Instant,
+    /// Time of the last wake in ns since base.
+    stamp: u64 = 0,
+    /// Flag for the consumer being about to sleep.
+    ready: u32 = 0,
+    /// Flag for the consumer having handled the last wake.
+    done: u32 = 0,
+    /// The measured latencies in ns.
+    samples: [iterations]u64 = undefined,
+
+    fn now(self: *Shared) u64 {
+        const instant = std.time.Instant.now() catch unreachable;
+        return instant.since(self.base);
+    }
+
+    /// Record the latency of the last wake, and tell the waker.
+    fn record(self: *Shared, i: usize) void {
+        self.samples[i] = self.now() - @atomicLoad(u64, &self.stamp, .acquire);
+        @atomicStore(u64, &self.stamp, 0, .monotonic);
+        @atomicStore(u32, &self.done, 1, .release);
+    }
+
+    /// Wait for the consumer to be asleep, then stamp the wake.
+    fn prepare_wake(self: *Shared, sleeping: *const u32) void {
+        while (@atomicLoad(u32, sleeping, .acquire) == 0) {
+            std.atomic.spinLoopHint();
+        }
+        std.Thread.sleep(settle_ns);
+        @atomicStore(u64, &self.stamp, self.now(), .release);
+    }
+
+    /// Wait for the consumer to handle the wake.
+    fn finish_wake(self: *Shared) void {
+        while (@atomicLoad(u32, &self.done, .acquire) == 0) {
+            std.atomic.spinLoopHint();
+        }
+        @atomicStore(u32, &self.done, 0, .monotonic);
+    }
+};
+
+fn futex_consumer(shared: *Shared, ring: *common.CommandRing) void {
+    var i: usize = 0;
+    while (i < iterations) {
+        const result = ring.wait(null) catch unreachable;
+        // spurious wakeups have no stamp to measure.
+        if (result == .woken and @atomicLoad(u64, &shared.stamp, .acquire) != 0) {
+            shared.record(i);
+            i += 1;
+        }
+    }
+}
+
+fn sem_consumer(shared: *Shared, sem: *std.c.sem_t) void {
+    for (0..iterations) |i| {
+        @atomicStore(u32, &shared.ready, 1, .release);
+        while (std.c.sem_wait(sem) != 0) {}
+        @atomicStore(u32, &shared.ready, 0, .monotonic);
+        shared.record(i);
+    }
+}
+
+fn bench_futex(shared: *Shared) !void {
+    var ring: common.CommandRing = undefined;
+    ring.init();
+    const thread = try std.Thread.spawn(.{}, futex_consumer, .{ shared, &ring });
+    for (0..iterations) |_| {
+        shared.prepare_wake(&ring.sleeping);
+        ring.wake();
+        shared.finish_wake();
+    }
+    thread.join();
+}
+
+fn bench_sem(shared: *Shared) !void {
+    const sem = std.c.sem_open(bench_sem_name, common.CREAT, std.c.S.IRUSR | std.c.S.IWUSR, 0) orelse
+        return error.sem_open_failed;
+    defer {
+        _ = std.c.sem_close(sem);
+        _ = std.c.sem_unlink(bench_sem_name);
+    }
+    const thread = try std.Thread.spawn(.{}, sem_consumer, .{ shared, sem });
+    for (0..iterations) |_| {
+        shared.prepare_wake(&shared.ready);
+        _ = std.c.sem_post(sem);
+        shared.finish_wake();
+    }
+    thread.join();
+}
+
+fn report(name: []const u8, samples: []u64) void {
+    std.mem.sort(u64, samples, {}, std.sort.asc(u64));
+    var sum: u64 = 0;
+    for (samples) |s| {
+        sum += s;
+    }
+    std.debug.print("{s:<10} mean {d:>8}ns  p50 {d:>8}ns  p99 {d:>8}ns  max {d:>8}ns\n", .{
+        name,
+        sum / samples.len,
+        samples[samples.len / 2],
+        samples[samples.len * 99 / 100],
+        samples[samples.len - 1],
+    });
+}
+
+/// Time fork/exec of the child, in ns.
+fn time_fork(allocator: std.mem.Allocator) !u64 {
+    var timer = try std.time.Timer.start();
+    var child = std.process.Child.init(&.{spawn_exe}, allocator);
+    _ = try child.spawnAndWait();
+    return timer.read();
+}
+
+/// Time posix_spawn of the child, in ns.
+fn time_posix_spawn(allocator: std.mem.Allocator) !u64 {
+    var timer = try std.time.Timer.start();
+    const pid = try spawn.spawn(allocator, &.{spawn_exe}, .{});
+    _ = spawn.wait(pid);
+    return timer.read();
+}
+
+fn bench_spawn() !void {
+    const allocator = std.heap.page_allocator;
+    var heap: std.ArrayList([]u8) = .empty;
+    defer {
+        for (heap.items) |block| {
+            allocator.free(block);
+        }
+        heap.deinit(allocator);
+    }
+    var rss_mib: usize = 0;
+    for (spawn_rss_mib) |target| {
+        // grow the resident size, touching every page so it is mapped.
+        while (rss_mib < target) : (rss_mib += 64) {
+            const block = try allocator.alloc(u8, 64 * 1024 * 1024);
+            @memset(block, 1);
+            try heap.append(allocator, block);
+        }
+        var fork_total: u64 = 0;
+        var spawn_total: u64 = 0;
+        for (0..spawn_iterations) |_| {
+            fork_total += try time_fork(allocator);
+            spawn_total += try time_posix_spawn(allocator);
+        }
+        std.debug.print("rss {d:>5}MiB  fork/exec mean {d:>8}ns  posix_spawn mean {d:>8}ns\n", .{
+            rss_mib,
+            fork_total / spawn_iterations,
+            spawn_total / spawn_iterations,
+        });
+    }
+}
+
+pub fn main() !void {
+    const shared = try std.heap.page_allocator.create(Shared);
+    defer std.heap.page_allocator.destroy(shared);
+
+    shared.* = .{ .base = try std.time.Instant.now() };
+    try bench_sem(shared);
+    report("semaphore", &shared.samples);
+
+    shared.* = .{ .base = try std.time.Instant.now() };
+    try bench_futex(shared);
+    report("futex", &shared.samples);
+
+    try bench_spawn();
+}
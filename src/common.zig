@@ -1,9 +1,13 @@
 const std = @import("std");
 
-/// Shared Memory name.
-pub const shm_name: [*:0]const u8 = "/jmatth11.player.nvim.player_exe.shm";
-/// Semaphore name.
-pub const sem_name: [*:0]const u8 = "/jmatth11.player.nvim.player_exe.sem";
+const linux = std.os.linux;
+
+/// Prefix of the shared memory names, followed by the controller PID.
+pub const shm_prefix = "jmatth11.player.nvim.";
+/// Suffix of the shared memory names.
+pub const shm_suffix = ".shm";
+/// Max length of a shared memory name.
+pub const shm_name_max: comptime_int = 64;
 /// Read and Write permissions.
 pub const RDWR: comptime_int = 0o2;
 /// Create permissions.
@@ -11,17 +15,544 @@ pub const CREAT: comptime_int = 0o100;
 /// Flag for Exclusive.
 pub const EXECL: comptime_int = 0o200;
 
-/// Shared Memory structure between the plugin and the player process.
-pub const SharedMem = struct {
-    /// The playtime of the current audio in seconds.
-    playtime: f64,
+/// Build the shared memory name of the given controller.
+/// Every neovim instance gets its own shared memory, so their players never
+/// see each other's commands.
+///
+/// @param buf The buffer to write the name to.
+/// @param pid The PID of the controller.
+/// @return The name, null terminated.
+pub fn shm_name(buf: *[shm_name_max]u8, pid: std.posix.pid_t) [:0]const u8 {
+    return std.fmt.bufPrintZ(buf, "/" ++ shm_prefix ++ "{d}" ++ shm_suffix, .{pid}) catch unreachable;
+}
+
+/// Build the name of the shared audio daemon's status memory.
+/// One daemon serves every neovim instance of the user.
+///
+/// @param buf The buffer to write the name to.
+/// @param uid The user ID.
+/// @return The name, null terminated.
+pub fn daemon_shm_name(buf: *[shm_name_max]u8, uid: std.posix.uid_t) [:0]const u8 {
+    return std.fmt.bufPrintZ(buf, "/" ++ shm_prefix ++ "daemon.{d}" ++ shm_suffix, .{uid}) catch unreachable;
+}
+
+/// Build the path of the shared audio daemon's socket.
+/// Lives in $XDG_RUNTIME_DIR, falls back to a directory in /tmp with the
+/// user ID in the name. That directory is created if missing, and only used
+/// if it is the user's own and nobody else can enter it.
+///
+/// @param buf The buffer to write the path to.
+/// @return The path, null if it does not fit a socket address or the
+///  directory is not private.
+pub fn daemon_socket_path(buf: *[socket_path_max]u8) ?[]const u8 {
+    const posix = std.posix;
+    if (posix.getenv("XDG_RUNTIME_DIR")) |dir| {
+        if (dir.len > 0) {
+            return std.fmt.bufPrint(buf, "{s}/" ++ shm_prefix ++ "sock", .{dir}) catch null;
+        }
+    }
+    const uid = std.c.getuid();
+    var dir_buf: [socket_path_max]u8 = undefined;
+    const dir = std.fmt.bufPrintZ(&dir_buf, "/tmp/" ++ shm_prefix ++ "{d}", .{uid}) catch return null;
+    posix.mkdirZ(dir, 0o700) catch |err| switch (err) {
+        error.PathAlreadyExists => {},
+        else => return null,
+    };
+    // anyone can create the name first, check what is there.
+    const stat = posix.fstatatZ(posix.AT.FDCWD, dir, posix.AT.SYMLINK_NOFOLLOW) catch return null;
+    if (!posix.S.ISDIR(stat.mode) or stat.uid != uid or stat.mode & 0o077 != 0) {
+        return null;
+    }
+    return std.fmt.bufPrint(buf, "{s}/sock", .{dir}) catch null;
+}
+
+/// Check the other end of a unix socket runs as the same user.
+///
+/// @param fd The connected socket.
+/// @return True if it does, false otherwise.
+pub fn peer_is_self(fd: std.posix.socket_t) bool {
+    var cred: linux.ucred = undefined;
+    var len: linux.socklen_t = @sizeOf(linux.ucred);
+    const rc = linux.getsockopt(fd, linux.SOL.SOCKET, linux.SO.PEERCRED, std.mem.asBytes(&cred), &len);
+    if (linux.E.init(rc) != .SUCCESS or len != @sizeOf(linux.ucred)) {
+        return false;
+    }
+    return cred.uid == std.c.getuid();
+}
+
+/// Max length of a unix socket path, without the null terminator.
+pub const socket_path_max: comptime_int = 107;
+
+/// Header of a command sent to the shared audio daemon.
+/// Sent as one SOCK_SEQPACKET message, followed by path_len bytes of path.
+pub const WireCommand = extern struct {
+    /// One of Command.
+    command: u8,
+    /// Padding.
+    reserved: [3]u8,
+    /// The volume argument of the command, between 0 - 1.
+    volume: f32,
+    /// The tick rate argument of the command in milliseconds, 0 for none.
+    tick_ms: u32,
+    /// Length of the file path argument that follows, 0 for none.
+    path_len: u32,
+};
+
+/// Max size of a message to the shared audio daemon.
+pub const wire_max: comptime_int = @sizeOf(WireCommand) + path_max;
+
+/// futex operations, without FUTEX_PRIVATE_FLAG since the word is shared
+/// between processes.
+const FUTEX_WAIT: usize = 0;
+const FUTEX_WAKE: usize = 1;
+
+/// Result of a futex wait.
+pub const WaitResult = enum {
+    /// Woken up, or the word did not hold the expected value anymore.
+    woken,
+    /// The timeout passed first.
+    timed_out,
+};
+
+/// Error values of the futex calls.
+pub const FutexError = error{
+    /// The futex syscall failed unexpectedly.
+    futex_failed,
+};
+
+/// Block while the word holds the expected value.
+/// Spurious wakeups are possible, callers recheck their condition.
+///
+/// @param word The futex word.
+/// @param expect The value to sleep on.
+/// @param timeout_ms The max time to sleep in milliseconds, null to sleep
+///  until woken.
+/// @return Whether the wait was woken or timed out.
+pub fn futex_wait(word: *const u32, expect: u32, timeout_ms: ?u32) FutexError!WaitResult {
+    var ts: linux.timespec = undefined;
+    var ts_ptr: usize = 0;
+    if (timeout_ms) |ms| {
+        // FUTEX_WAIT takes a relative timeout.
+        ts = .{
+            .sec = @intCast(ms / std.time.ms_per_s),
+            .nsec = @intCast(@as(u64, ms % std.time.ms_per_s) * std.time.ns_per_ms),
+        };
+        ts_ptr = @intFromPtr(&ts);
+    }
+    const rc = linux.syscall4(.futex, @intFromPtr(word), FUTEX_WAIT, expect, ts_ptr);
+    return switch (linux.E.init(rc)) {
+        .SUCCESS, .AGAIN, .INTR => .woken,
+        .TIMEDOUT => .timed_out,
+        else => FutexError.futex_failed,
+    };
+}
+
+/// Wake one waiter blocked on the word.
+///
+/// @param word The futex word.
+pub fn futex_wake(word: *const u32) void {
+    _ = linux.syscall3(.futex, @intFromPtr(word), FUTEX_WAKE, 1);
+}
+
+/// Max length of a file path sent to the player process.
+pub const path_max: comptime_int = 4096;
+
+/// Slots in the command ring, must be a power of two.
+pub const ring_size: comptime_int = 16;
+
+/// Commands for the player process.
+pub const Command = enum(u8) {
+    /// Nothing to do.
+    none,
+    /// Play the file in path, replacing the current song.
+    load,
+    /// Play the file in path once the current song ends.
+    enqueue,
+    /// Unload the current song.
+    stop,
+    /// Pause the current song.
+    pause,
+    /// Resume the current song.
+    @"resume",
+    /// Set the volume.
+    volume,
+    /// Set the rate of position tick events.
+    tick,
+    /// Exit the player process.
+    quit,
+};
+
+/// A command in the command ring.
+pub const CommandSlot = struct {
+    /// Tells producers and the consumer whose turn the slot is.
+    seq: u32,
+    /// The command.
+    command: Command,
+    /// The volume argument of the command, between 0 - 1.
+    volume: f32,
+    /// The tick rate argument of the command in milliseconds, 0 for none.
+    tick_ms: u32,
+    /// The file path argument of the command, null terminated.
+    path: [path_max]u8,
+};
+
+/// Latest-value settings of the player.
+/// Only the last value matters, so they never take a ring slot and a full
+/// ring can not drop them.
+pub const Settings = struct {
+    /// Bumped after every change.
+    seq: u32,
+    /// Bits of the volume, between 0 - 1.
+    volume: u32,
+    /// The rate of tick events in milliseconds, 0 for none.
+    tick_ms: u32,
+};
+
+/// Bounded lock-free multi-producer single-consumer command ring.
+/// Every command gets a sequence number, the consumer acknowledges the
+/// sequence numbers it has applied.
+pub const CommandRing = struct {
+    /// Sequence number of the next pushed command.
+    head: u32,
+    /// Sequence number of the next command the consumer reads.
+    tail: u32,
+    /// Commands with a sequence number below this were applied.
+    acked: u32,
+    /// Flag for the consumer sleeping, also the futex word it sleeps on.
+    sleeping: u32,
+    /// The settings, next to the commands.
+    settings: Settings,
+    /// Sequence of the settings the consumer applied last.
+    settings_seen: u32,
+    /// The commands.
+    slots: [ring_size]CommandSlot,
+
+    /// Reset the ring. Only call while no one else uses it.
+    pub fn init(self: *CommandRing) void {
+        self.head = 0;
+        self.tail = 0;
+        self.acked = 0;
+        self.sleeping = 0;
+        self.settings = .{ .seq = 0, .volume = @bitCast(@as(f32, 1.0)), .tick_ms = 0 };
+        self.settings_seen = 0;
+        for (&self.slots, 0..) |*slot, i| {
+            slot.seq = @intCast(i);
+            slot.command = .none;
+        }
+    }
+
+    /// Push a command.
+    ///
+    /// @param command The command.
+    /// @param volume The volume argument.
+    /// @param tick_ms The tick rate argument.
+    /// @param path The file path argument, if any.
+    /// @return The sequence number of the command, null if the ring is full
+    ///  or the path is too long.
+    pub fn push(self: *CommandRing, command: Command, volume: f32, tick_ms: u32, path: ?[]const u8) ?u32 {
+        if (path) |p| {
+            if (p.len >= path_max) {
+                return null;
+            }
+        }
+        var pos = @atomicLoad(u32, &self.head, .monotonic);
+        var slot: *CommandSlot = undefined;
+        while (true) {
+            slot = &self.slots[pos & (ring_size - 1)];
+            const seq = @atomicLoad(u32, &slot.seq, .acquire);
+            const diff: i32 = @bitCast(seq -% pos);
+            if (diff == 0) {
+                // the slot is free, claim it.
+                if (@cmpxchgWeak(u32, &self.head, pos, pos +% 1, .monotonic, .monotonic)) |actual| {
+                    pos = actual;
+                } else {
+                    break;
+                }
+            } else if (diff < 0) {
+                // the consumer has not read this slot yet, the ring is full.
+                return null;
+            } else {
+                // another producer claimed the slot first.
+                pos = @atomicLoad(u32, &self.head, .monotonic);
+            }
+        }
+        slot.command = command;
+        slot.volume = volume;
+        slot.tick_ms = tick_ms;
+        if (path) |p| {
+            @memcpy(slot.path[0..p.len], p);
+            slot.path[p.len] = 0;
+        } else {
+            slot.path[0] = 0;
+        }
+        // hand the slot to the consumer.
+        @atomicStore(u32, &slot.seq, pos +% 1, .release);
+        return pos;
+    }
+
+    /// Set the volume and tick rate.
+    /// Call wake afterwards, like after a push.
+    ///
+    /// @param volume The volume, between 0 - 1.
+    /// @param tick_ms The tick rate in milliseconds, 0 for none.
+    pub fn set_settings(self: *CommandRing, volume: f32, tick_ms: u32) void {
+        @atomicStore(u32, &self.settings.volume, @bitCast(volume), .monotonic);
+        @atomicStore(u32, &self.settings.tick_ms, tick_ms, .monotonic);
+        _ = @atomicRmw(u32, &self.settings.seq, .Add, 1, .release);
+    }
+
+    /// Take the settings if they changed since the last call. Consumer only.
+    /// A change racing with the read bumps the sequence again, so it is
+    /// taken on the next call.
+    ///
+    /// @return The settings, null if they did not change.
+    pub fn take_settings(self: *CommandRing) ?Settings {
+        const seq = @atomicLoad(u32, &self.settings.seq, .acquire);
+        if (seq == self.settings_seen) {
+            return null;
+        }
+        self.settings_seen = seq;
+        return .{
+            .seq = seq,
+            .volume = @atomicLoad(u32, &self.settings.volume, .monotonic),
+            .tick_ms = @atomicLoad(u32, &self.settings.tick_ms, .monotonic),
+        };
+    }
+
+    /// Get the next command without removing it. Consumer only.
+    ///
+    /// @return The command, null if the ring is empty.
+    pub fn peek(self: *CommandRing) ?*const CommandSlot {
+        const slot = &self.slots[self.tail & (ring_size - 1)];
+        if (@atomicLoad(u32, &slot.seq, .acquire) != self.tail +% 1) {
+            return null;
+        }
+        return slot;
+    }
+
+    /// Remove the command returned by peek. Consumer only.
+    pub fn pop(self: *CommandRing) void {
+        const slot = &self.slots[self.tail & (ring_size - 1)];
+        // hand the slot back to the producers for the next lap.
+        @atomicStore(u32, &slot.seq, self.tail +% ring_size, .release);
+        @atomicStore(u32, &self.tail, self.tail +% 1, .monotonic);
+    }
+
+    /// Acknowledge every command that was popped. Consumer only.
+    pub fn ack(self: *CommandRing) void {
+        @atomicStore(u32, &self.acked, self.tail, .release);
+    }
+
+    /// Wake the consumer if it is sleeping.
+    /// It drains the whole ring on every wakeup, so a busy one is left alone.
+    pub fn wake(self: *CommandRing) void {
+        if (@atomicRmw(u32, &self.sleeping, .Xchg, 0, .seq_cst) == 1) {
+            futex_wake(&self.sleeping);
+        }
+    }
+
+    /// Sleep until a producer calls wake. Consumer only.
+    /// Returns right away when a command was pushed since the last check.
+    ///
+    /// @param timeout_ms The max time to sleep in milliseconds, null for none.
+    /// @return Whether the wait was woken or timed out.
+    pub fn wait(self: *CommandRing, timeout_ms: ?u32) FutexError!WaitResult {
+        // tell producers to wake us up, then check again so a command pushed
+        // in between is not slept through.
+        @atomicStore(u32, &self.sleeping, 1, .seq_cst);
+        if (self.peek() != null or @atomicLoad(u32, &self.settings.seq, .seq_cst) != self.settings_seen) {
+            @atomicStore(u32, &self.sleeping, 0, .seq_cst);
+            return .woken;
+        }
+        // a wake in between flips the word back to 0, so this does not block.
+        const result = futex_wait(&self.sleeping, 1, timeout_ms);
+        @atomicStore(u32, &self.sleeping, 0, .seq_cst);
+        return result;
+    }
+
+    /// Get the amount of pushed commands that were not applied yet.
+    pub fn pending(self: *CommandRing) u32 {
+        return @atomicLoad(u32, &self.head, .monotonic) -% @atomicLoad(u32, &self.acked, .acquire);
+    }
+};
+
+/// Slots in the event ring, must be a power of two.
+pub const event_ring_size: comptime_int = 32;
+
+/// Kinds of events from the player process.
+pub const EventKind = enum(u8) {
+    /// Nothing happened.
+    none,
+    /// A song started playing.
+    started,
+    /// The song played to its end.
+    ended,
+    /// A song failed to play.
+    @"error",
+    /// Position update while playing.
+    tick,
+};
+
+/// An event from the player process.
+/// Laid out for C so the plugin can hand it to Lua as is.
+pub const Event = extern struct {
+    /// One of EventKind.
+    kind: u8,
+    /// Padding.
+    reserved: [3]u8,
+    /// The sample rate of the frame position.
+    sample_rate: u32,
+    /// The position of the current audio in frames.
+    frames: u64,
+};
+
+/// Bounded lock-free single-producer single-consumer event ring.
+/// The player process pushes, the plugin pops.
+pub const EventRing = struct {
+    /// Count of pushed events.
+    head: u32,
+    /// Count of popped events.
+    tail: u32,
+    /// The events.
+    events: [event_ring_size]Event,
+
+    /// Reset the ring. Only call while no one else uses it.
+    pub fn init(self: *EventRing) void {
+        self.head = 0;
+        self.tail = 0;
+    }
+
+    /// Push an event. Producer only.
+    ///
+    /// @return True on success, false if the ring is full.
+    pub fn push(self: *EventRing, event: Event) bool {
+        const head = self.head;
+        if (head -% @atomicLoad(u32, &self.tail, .acquire) >= event_ring_size) {
+            return false;
+        }
+        self.events[head & (event_ring_size - 1)] = event;
+        @atomicStore(u32, &self.head, head +% 1, .release);
+        return true;
+    }
+
+    /// Pop the oldest event. Consumer only.
+    ///
+    /// @return The event, null if the ring is empty.
+    pub fn pop(self: *EventRing) ?Event {
+        const tail = self.tail;
+        if (tail == @atomicLoad(u32, &self.head, .acquire)) {
+            return null;
+        }
+        const event = self.events[tail & (event_ring_size - 1)];
+        @atomicStore(u32, &self.tail, tail +% 1, .release);
+        return event;
+    }
+};
+
+/// Status of the player.
+/// Laid out for C so the plugin can hand it to Lua as is.
+pub const Status = extern struct {
+    /// The position of the current audio in frames.
+    frames: u64,
     /// The total length of the audio in seconds.
     length: u64,
-    /// The volume of the player.
-    volume: f32,
-    /// Flag for if the audio is playing or not.
-    is_playing: bool,
-    /// Flag to signal the player process to stop.
-    should_stop: bool,
+    /// The sample rate of the frame position.
+    sample_rate: u32,
+    /// Flag for if the audio is playing, 1 for true.
+    is_playing: u8,
+    /// Flag for if a song is loaded whether it is playing or paused, 1 for true.
+    in_progress: u8,
+    /// Padding.
+    reserved: u16,
+};
+
+/// Tries a status read makes before it takes the block as abandoned.
+/// A live writer holds the lock for a few stores, far below this.
+pub const status_read_tries: comptime_int = 1 << 16;
+
+/// Seqlock around the player status, so readers always get the fields of
+/// one update together.
+/// Writers take the lock by making the sequence odd, readers retry while it
+/// is odd or changed under them.
+pub const StatusBlock = struct {
+    /// Sequence of the status, odd while a writer holds it.
+    seq: u32,
+    /// The status.
+    status: Status,
+
+    /// Reset the block. Only call while no one else uses it.
+    pub fn init(self: *StatusBlock) void {
+        self.seq = 0;
+        self.status = std.mem.zeroes(Status);
+    }
+
+    /// Try to lock the block for writing without waiting.
+    ///
+    /// @return The current status to change and hand to unlock, null if
+    ///  another writer holds the lock.
+    pub fn tryLock(self: *StatusBlock) ?Status {
+        const seq = @atomicLoad(u32, &self.seq, .monotonic);
+        if (seq & 1 != 0) {
+            return null;
+        }
+        if (@cmpxchgStrong(u32, &self.seq, seq, seq +% 1, .acquire, .monotonic) != null) {
+            return null;
+        }
+        // only writers change the status, so it is stable under the lock.
+        return self.status;
+    }
+
+    /// Lock the block for writing, waiting while another writer holds it.
+    ///
+    /// @return The current status to change and hand to unlock.
+    pub fn lock(self: *StatusBlock) Status {
+        while (true) {
+            if (self.tryLock()) |status| {
+                return status;
+            }
+            std.atomic.spinLoopHint();
+        }
+    }
+
+    /// Publish the changed status and unlock the block.
+    pub fn unlock(self: *StatusBlock, status: Status) void {
+        inline for (std.meta.fields(Status)) |field| {
+            @atomicStore(field.type, &@field(self.status, field.name), @field(status, field.name), .monotonic);
+        }
+        @atomicStore(u32, &self.seq, self.seq +% 1, .release);
+    }
+
+    /// Read a consistent snapshot of the status.
+    /// A writer killed between tryLock and unlock leaves the block locked
+    /// for good, so the reader gives up after a bounded number of tries.
+    ///
+    /// @return The snapshot, null if the block stayed locked.
+    pub fn read(self: *StatusBlock) ?Status {
+        for (0..status_read_tries) |_| {
+            const seq = @atomicLoad(u32, &self.seq, .acquire);
+            if (seq & 1 == 0) {
+                var status: Status = undefined;
+                // acquire loads keep the second sequence check after them.
+                inline for (std.meta.fields(Status)) |field| {
+                    @field(status, field.name) = @atomicLoad(field.type, &@field(self.status, field.name), .acquire);
+                }
+                if (@atomicLoad(u32, &self.seq, .monotonic) == seq) {
+                    return status;
+                }
+            }
+            std.atomic.spinLoopHint();
+        }
+        return null;
+    }
+};
+
+/// Shared Memory structure between the plugin and the player process.
+pub const SharedMem = struct {
+    /// Status of the player, written by the player process.
+    status: StatusBlock,
+    /// Commands from the plugin to the player process.
+    commands: CommandRing,
+    /// Events from the player process to the plugin.
+    events: EventRing,
 };
 
@@ -1,25 +1,38 @@
 const std = @import("std");
 
+// the library scanner, for the in-process mode.
+comptime {
+    _ = @import("scan.zig");
+}
+
+// the library watcher, for the in-process mode.
+comptime {
+    _ = @import("watch.zig");
+}
+
 pub const c = @cImport({
     @cInclude("play.h");
 });
 
 /// Playback callback for the player.
-pub const playback_cb = *const fn(elapsed_time: f64, ended: bool) callconv(.c) void;
+pub const playback_cb = *const fn(position: u64, ended: bool) callconv(.c) void;
 
 /// The singleton player instance.
 var player: ?*c.player_t = null;
 
 /// Setup the player.
 ///
-/// @param cb The playback callback.
-pub export fn setup(cb: playback_cb) void {
+/// @param cb The playback callback, null for none.
+/// @return 1 for success, 0 for failure.
+pub export fn setup(cb: ?playback_cb) c_int {
     if (player == null) {
         player = c.player_create(@ptrCast(cb));
     }
+    return @intFromBool(player != null);
 }
 
 /// Play the given song with the player.
+/// Returns right away, the decode thread opens and starts the song.
 ///
 /// @param file_name The song filename.
 /// @return 1 for success, 0 for failure.
@@ -27,33 +40,161 @@ pub export fn play(file_name: [*:0]const u8) c_int {
     if (player == null) {
         return 0;
     }
-    if (!c.player_play(player, file_name)) {
+    if (!c.player_post_play(player, file_name)) {
         std.log.err("failed to play file", .{});
         return 0;
     }
     return 1;
 }
 
+/// Enqueue the next song to play once the current one ends.
+/// Returns right away, the decode thread opens the song.
+///
+/// @param file_name The song filename.
+/// @return 1 for success, 0 for failure.
+pub export fn enqueue_next(file_name: [*:0]const u8) c_int {
+    if (player == null) {
+        return 0;
+    }
+    if (!c.player_post_enqueue_next(player, file_name)) {
+        std.log.err("failed to enqueue file", .{});
+        return 0;
+    }
+    return 1;
+}
+
+/// Blocking variants of the control calls for the player process.
+/// The process runs them off the editor, and needs their outcome to report
+/// a song that does not open as an error event.
+pub const sync = struct {
+    /// Play the given song, once it is open and started.
+    ///
+    /// @param file_name The song filename.
+    /// @return 1 for success, 0 for failure.
+    pub fn play(file_name: [*:0]const u8) c_int {
+        const p = player orelse return 0;
+        if (!c.player_play(p, file_name)) {
+            std.log.err("failed to play file", .{});
+            return 0;
+        }
+        return 1;
+    }
+
+    /// Enqueue the next song to play once the current one ends.
+    /// Plays it right away if nothing is left of the current one.
+    ///
+    /// @param file_name The song filename.
+    /// @return 1 for success, 0 for failure.
+    pub fn enqueue_next(file_name: [*:0]const u8) c_int {
+        const p = player orelse return 0;
+        if (!c.player_enqueue_next(p, file_name)) {
+            std.log.err("failed to enqueue file", .{});
+            return 0;
+        }
+        return 1;
+    }
+
+    /// Pause the player.
+    pub fn pause() void {
+        if (player) |p| {
+            c.player_pause(p);
+        }
+    }
+
+    /// Resume the player.
+    pub fn @"resume"() void {
+        if (player) |p| {
+            c.player_resume(p);
+        }
+    }
+
+    /// Stop the player, once the song is unloaded and the device stopped.
+    ///
+    /// @return 1 for success, 0 for failure.
+    pub fn stop() c_int {
+        if (player) |p| {
+            return @intFromBool(c.player_stop(p));
+        }
+        return 1;
+    }
+};
+
+/// Set the crossfade between consecutive songs.
+///
+/// @param ms The crossfade length in milliseconds, 0 for gapless playback.
+pub export fn set_crossfade(ms: u32) void {
+    if (player) |p| {
+        c.player_set_crossfade(p, ms);
+    }
+}
+
+/// Seek the current song to the given frame.
+/// Returns right away, the decode thread seeks.
+///
+/// @param frame The frame to seek to, in the player's sample rate.
+/// @return 1 for success, 0 for failure.
+pub export fn seek(frame: u64) c_int {
+    if (player) |p| {
+        return @intFromBool(c.player_post_seek(p, frame));
+    }
+    return 0;
+}
+
+/// Seek the current song relative to the current position.
+/// Returns right away, the decode thread seeks.
+///
+/// @param offset The amount of frames to move, negative to move backwards.
+/// @return 1 for success, 0 for failure.
+pub export fn seek_relative(offset: i64) c_int {
+    if (player) |p| {
+        var current: u64 = 0;
+        if (!c.player_get_position_frames(p, &current)) {
+            return 0;
+        }
+        const target: u64 = if (offset >= 0)
+            current +| @as(u64, @intCast(offset))
+        else
+            current -| @abs(offset);
+        return @intFromBool(c.player_post_seek(p, target));
+    }
+    return 0;
+}
+
+/// Get the sample rate of the player's output.
+pub export fn get_sample_rate() u32 {
+    if (player) |p| {
+        return c.player_get_sample_rate(p);
+    }
+    return 0;
+}
+
 /// Pause the player.
+/// Returns right away, the decode thread pauses after the pending requests.
 pub export fn pause() void {
     if (player) |p| {
-        c.player_pause(p);
+        if (!c.player_post_pause(p)) {
+            std.log.err("failed to pause", .{});
+        }
     }
 }
 
 /// Resume the player.
+/// Returns right away, the decode thread resumes after the pending requests.
 pub export fn @"resume"() void {
     if (player) |p| {
-        c.player_resume(p);
+        if (!c.player_post_resume(p)) {
+            std.log.err("failed to resume", .{});
+        }
     }
 }
 
 /// Stop the player.
+/// Returns right away, the decode thread unloads the song.
 ///
 /// @return 1 for success, 0 for failure.
 pub export fn stop() c_int {
     if (player) |p| {
-        if (!c.player_stop(p)) {
+        if (!c.player_post_stop(p)) {
             return 0;
         }
     }
@@ -70,6 +211,26 @@ pub export fn has_stopped() c_int {
     return 0;
 }
 
+/// Flag for if the player is playing.
+///
+/// @return 1 for true, 0 for false.
+pub export fn is_playing() c_int {
+    if (player) |p| {
+        return @intFromBool(c.player_is_playing(p));
+    }
+    return 0;
+}
+
+/// Flag for if a song is loaded, whether it is playing or paused.
+///
+/// @return 1 for true, 0 for false.
+pub export fn in_progress() c_int {
+    if (player) |p| {
+        return @intFromBool(c.player_in_progress(p));
+    }
+    return 0;
+}
+
 /// Get the volume of the player.
 pub export fn get_volume() f32 {
     if (player) |p| {
@@ -90,6 +251,30 @@ pub export fn get_current_playtime() u64 {
     return 0;
 }
 
+/// Get the current position of the audio in frames.
+pub export fn get_position_frames() u64 {
+    if (player) |p| {
+        var position: u64 = 0;
+        if (!c.player_get_position_frames(p, &position)) {
+            return 0;
+        }
+        return position;
+    }
+    return 0;
+}
+
+/// Get the position of the audio in frames as it is heard right now.
+pub export fn get_position() u64 {
+    if (player) |p| {
+        var position: u64 = 0;
+        if (!c.player_get_position(p, &position)) {
+            return 0;
+        }
+        return position;
+    }
+    return 0;
+}
+
 /// Get the total time of the audio in seconds.
 pub export fn get_audio_length() u64 {
     if (player) |p| {
@@ -111,6 +296,25 @@ pub export fn set_volume(vol: f32) void {
     }
 }
 
+/// Set the volume of the player in decibels.
+///
+/// @param db The gain in decibels, 0 for unity.
+pub export fn set_volume_db(db: f32) void {
+    if (player) |p| {
+        c.player_set_volume_db(p, db);
+    }
+}
+
+/// Set how volume changes are ramped in.
+///
+/// @param ms The ramp length in milliseconds, 0 to jump.
+/// @param law 0 to ramp linearly in gain, 1 to ramp in decibels.
+pub export fn set_volume_ramp(ms: u32, law: c_int) void {
+    if (player) |p| {
+        c.player_set_volume_ramp(p, ms, @intCast(law));
+    }
+}
+
 /// Deinitialize the player instance.
 pub export fn deinit() void {
     if (player != null) {
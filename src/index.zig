@@ -0,0 +1,423 @@
+//! The on-disk library index.
+//! One file per scanned directory under $XDG_DATA_HOME/player.nvim/library,
+//! laid out as a header, the directory records, the file records and a
+//! string table, so it is used straight from an mmap without parsing.
+const std = @import("std");
+const posix = std.posix;
+const tags = @import("tags.zig");
+
+/// Magic bytes at the start of every index file.
+const magic = "PNLI";
+/// Bump when the index file layout changes.
+const version: u32 = 1;
+/// Max path length of an index file.
+pub const path_max: comptime_int = 4096;
+
+/// A string in the string table.
+pub const Str = extern struct {
+    offset: u32,
+    len: u32,
+};
+
+/// Header of an index file.
+pub const Header = extern struct {
+    /// Magic bytes.
+    magic: [4]u8,
+    /// Index file layout version.
+    version: u32,
+    /// Number of directory records.
+    dir_count: u32,
+    /// Number of file records.
+    file_count: u32,
+    /// Size of the string table in bytes.
+    strings_size: u64,
+    /// The scanned directory.
+    root: Str,
+    /// 1 if sub directories were scanned.
+    recursive: u32,
+    /// Padding.
+    reserved: u32,
+};
+
+/// A scanned directory.
+/// Written breadth first, so the children of a directory are contiguous,
+/// and so are its files.
+pub const DirRecord = extern struct {
+    /// Modification time of the directory in seconds.
+    mtime_sec: i64,
+    /// Modification time of the directory in nanoseconds.
+    mtime_nsec: i64,
+    /// The directory path.
+    path: Str,
+    /// Index of the first sub directory.
+    first_child: u32,
+    /// Number of sub directories.
+    child_count: u32,
+    /// Index of the first file, files are sorted by name.
+    first_file: u32,
+    /// Number of files.
+    file_count: u32,
+};
+
+/// An audio file.
+pub const FileRecord = extern struct {
+    /// Size of the file.
+    size: u64,
+    /// Modification time of the file in seconds.
+    mtime_sec: i64,
+    /// Modification time of the file in nanoseconds.
+    mtime_nsec: i64,
+    /// Duration in milliseconds, 0 if unknown.
+    duration_ms: u32,
+    /// The tags.Format of the file.
+    format: u8,
+    /// Padding.
+    reserved: [3]u8,
+    /// Index of the directory of the file.
+    dir: u32,
+    /// Offset of the file name in the path.
+    name_offset: u32,
+    /// The full path of the file.
+    path: Str,
+    title: Str,
+    artist: Str,
+    album: Str,
+
+    /// Get the file name.
+    pub fn name(self: *const FileRecord, index: *const Index) []const u8 {
+        const path = index.str(self.path);
+        return path[@min(self.name_offset, path.len)..];
+    }
+};
+
+/// A mapped index file.
+pub const Index = struct {
+    data: []align(std.heap.page_size_min) const u8,
+    dirs: []const DirRecord,
+    files: []const FileRecord,
+    strings: []const u8,
+
+    /// Map the index file of a directory.
+    ///
+    /// @param path The index file.
+    /// @param root The scanned directory the index must belong to.
+    /// @param recursive Flag the index must have been scanned with.
+    /// @return The index, null if it is missing, stale or corrupt.
+    pub fn open(path: [*:0]const u8, root: []const u8, recursive: bool) ?Index {
+        const fd = posix.openZ(path, .{ .CLOEXEC = true }, 0) catch return null;
+        defer posix.close(fd);
+        const stat = posix.fstat(fd) catch return null;
+        const size: u64 = @intCast(stat.size);
+        if (size < @sizeOf(Header)) {
+            return null;
+        }
+        const data = posix.mmap(null, size, posix.PROT.READ, .{ .TYPE = .PRIVATE }, fd, 0) catch return null;
+        const header: *const Header = @ptrCast(data.ptr);
+        const dirs_size = @as(u64, header.dir_count) * @sizeOf(DirRecord);
+        const files_size = @as(u64, header.file_count) * @sizeOf(FileRecord);
+        // the sizes of a corrupt header may add up past u64.
+        const records_size = @sizeOf(Header) + dirs_size + files_size;
+        const total = std.math.add(u64, records_size, header.strings_size) catch 0;
+        if (!std.mem.eql(u8, &header.magic, magic) or header.version != version or total != size) {
+            posix.munmap(data);
+            return null;
+        }
+        const dirs_ptr: [*]const DirRecord = @ptrCast(@alignCast(data.ptr + @sizeOf(Header)));
+        const files_ptr: [*]const FileRecord = @ptrCast(@alignCast(data.ptr + @sizeOf(Header) + dirs_size));
+        const index: Index = .{
+            .data = data,
+            .dirs = dirs_ptr[0..header.dir_count],
+            .files = files_ptr[0..header.file_count],
+            .strings = data[@sizeOf(Header) + dirs_size + files_size ..],
+        };
+        // the hash in the file name may collide.
+        if (!std.mem.eql(u8, index.str(header.root), root) or header.recursive != @intFromBool(recursive)) {
+            posix.munmap(data);
+            return null;
+        }
+        return index;
+    }
+
+    /// Unmap the index.
+    pub fn close(self: *Index) void {
+        posix.munmap(self.data);
+    }
+
+    /// Get a string of the string table.
+    /// Out of range strings of a corrupt index are empty.
+    pub fn str(self: *const Index, s: Str) []const u8 {
+        if (s.offset > self.strings.len or s.len > self.strings.len - s.offset) {
+            return "";
+        }
+        return self.strings[s.offset .. s.offset + s.len];
+    }
+
+    /// Get the files of a directory.
+    pub fn files_of(self: *const Index, dir: *const DirRecord) []const FileRecord {
+        if (dir.first_file > self.files.len or dir.file_count > self.files.len - dir.first_file) {
+            return &.{};
+        }
+        return self.files[dir.first_file .. dir.first_file + dir.file_count];
+    }
+
+    /// Get the sub directories of a directory.
+    pub fn children_of(self: *const Index, dir: *const DirRecord) []const DirRecord {
+        if (dir.first_child > self.dirs.len or dir.child_count > self.dirs.len - dir.first_child) {
+            return &.{};
+        }
+        return self.dirs[dir.first_child .. dir.first_child + dir.child_count];
+    }
+
+    /// Find a file of a directory by name.
+    ///
+    /// @return The file, null if the directory has none of that name.
+    pub fn find_file(self: *const Index, dir: *const DirRecord, name: []const u8) ?*const FileRecord {
+        const files = self.files_of(dir);
+        var low: usize = 0;
+        var high: usize = files.len;
+        while (low < high) {
+            const mid = low + (high - low) / 2;
+            switch (std.mem.order(u8, files[mid].name(self), name)) {
+                .eq => return &files[mid],
+                .lt => low = mid + 1,
+                .gt => high = mid,
+            }
+        }
+        return null;
+    }
+};
+
+/// Create the directory if it does not exist yet.
+fn ensure_dir(path: []const u8) bool {
+    std.fs.cwd().makeDir(path) catch |err| switch (err) {
+        error.PathAlreadyExists => {},
+        else => return false,
+    };
+    return true;
+}
+
+/// Get the index file path of a directory.
+/// Uses $XDG_DATA_HOME/player.nvim/library, falls back to
+/// $HOME/.local/share/player.nvim/library.
+///
+/// @param buf The buffer to write the path into.
+/// @param root The scanned directory.
+/// @param recursive Flag of sub directories being scanned.
+/// @param create Flag to create the missing directories of the path.
+/// @return The path, null if it does not fit or can not be created.
+pub fn index_path(buf: *[path_max]u8, root: []const u8, recursive: bool, create: bool) ?[:0]const u8 {
+    var dir_buf: [path_max]u8 = undefined;
+    var len: usize = 0;
+    const xdg = std.posix.getenv("XDG_DATA_HOME") orelse "";
+    const parts: []const []const u8 = if (xdg.len > 0)
+        &.{ xdg, "/player.nvim", "/library" }
+    else
+        &.{ std.posix.getenv("HOME") orelse return null, "/.local", "/share", "/player.nvim", "/library" };
+    for (parts) |part| {
+        if (part.len == 0 or len + part.len > dir_buf.len) {
+            return null;
+        }
+        @memcpy(dir_buf[len .. len + part.len], part);
+        len += part.len;
+        if (create and !ensure_dir(dir_buf[0..len])) {
+            return null;
+        }
+    }
+    var hash = std.hash.Fnv1a_64.init();
+    hash.update(root);
+    hash.update(if (recursive) "/r" else "/");
+    return std.fmt.bufPrintZ(buf, "{s}/{x:0>16}.idx", .{ dir_buf[0..len], hash.final() }) catch null;
+}
+
+/// Builds an index in memory and writes it out.
+pub const Writer = struct {
+    dirs: std.ArrayList(DirRecord) = .empty,
+    files: std.ArrayList(FileRecord) = .empty,
+    strings: std.ArrayList(u8) = .empty,
+    allocator: std.mem.Allocator,
+
+    pub fn init(allocator: std.mem.Allocator) Writer {
+        return .{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Writer) void {
+        self.dirs.deinit(self.allocator);
+        self.files.deinit(self.allocator);
+        self.strings.deinit(self.allocator);
+    }
+
+    /// Add a string to the string table.
+    /// Strings are NUL terminated in the table, the length leaves it out.
+    pub fn add_str(self: *Writer, s: []const u8) !Str {
+        if (self.strings.items.len + s.len + 1 > std.math.maxInt(u32)) {
+            return error.OutOfMemory;
+        }
+        const offset: u32 = @intCast(self.strings.items.len);
+        try self.strings.appendSlice(self.allocator, s);
+        try self.strings.append(self.allocator, 0);
+        return .{ .offset = offset, .len = @intCast(s.len) };
+    }
+
+    /// Add a file of the last added directory.
+    pub fn add_file(self: *Writer, path: []const u8, name_offset: usize, size: u64, mtime_sec: i64, mtime_nsec: i64, info: tags.Info) !void {
+        try self.files.append(self.allocator, .{
+            .size = size,
+            .mtime_sec = mtime_sec,
+            .mtime_nsec = mtime_nsec,
+            .duration_ms = info.duration_ms,
+            .format = @intFromEnum(info.format),
+            .reserved = .{ 0, 0, 0 },
+            .dir = @intCast(self.dirs.items.len - 1),
+            .name_offset = @intCast(name_offset),
+            .path = try self.add_str(path),
+            .title = try self.add_str(info.title),
+            .artist = try self.add_str(info.artist),
+            .album = try self.add_str(info.album),
+        });
+    }
+
+    /// Write the index file, replacing the old one.
+    ///
+    /// @param path The index file.
+    /// @param root The scanned directory.
+    /// @param recursive Flag of sub directories being scanned.
+    pub fn write(self: *Writer, path: [:0]const u8, root: []const u8, recursive: bool) !void {
+        const root_str = try self.add_str(root);
+        const header: Header = .{
+            .magic = magic.*,
+            .version = version,
+            .dir_count = @intCast(self.dirs.items.len),
+            .file_count = @intCast(self.files.items.len),
+            .strings_size = self.strings.items.len,
+            .root = root_str,
+            .recursive = @intFromBool(recursive),
+            .reserved = 0,
+        };
+        // write to a temp file first so readers never map a partial index.
+        // the scanner and the watcher may both write one, the thread keeps
+        // their temp files apart.
+        var tmp_buf: [path_max + 32]u8 = undefined;
+        const tmp_path = try std.fmt.bufPrintZ(&tmp_buf, "{s}.{d}.{d}.tmp", .{ path, std.os.linux.getpid(), std.Thread.getCurrentId() });
+        const file = try std.fs.cwd().createFile(tmp_path, .{ .mode = 0o600 });
+        var ok = true;
+        file.writeAll(std.mem.asBytes(&header)) catch {
+            ok = false;
+        };
+        if (ok) {
+            file.writeAll(std.mem.sliceAsBytes(self.dirs.items)) catch {
+                ok = false;
+            };
+        }
+        if (ok) {
+            file.writeAll(std.mem.sliceAsBytes(self.files.items)) catch {
+                ok = false;
+            };
+        }
+        if (ok) {
+            file.writeAll(self.strings.items) catch {
+                ok = false;
+            };
+        }
+        file.close();
+        if (ok) {
+            posix.renameZ(tmp_path, path) catch {
+                ok = false;
+            };
+        }
+        if (!ok) {
+            posix.unlinkZ(tmp_path) catch {};
+            return error.write_failed;
+        }
+    }
+};
+
+/// Write a one directory index of two files for the tests.
+///
+/// @return The index file path, free with the testing allocator.
+fn write_test_index(tmp: *std.testing.TmpDir) ![:0]u8 {
+    const allocator = std.testing.allocator;
+    const dir = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir);
+    const path = try std.fmt.allocPrintSentinel(allocator, "{s}/test.idx", .{dir}, 0);
+    errdefer allocator.free(path);
+    var writer = Writer.init(allocator);
+    defer writer.deinit();
+    try writer.dirs.append(allocator, .{
+        .mtime_sec = 1,
+        .mtime_nsec = 2,
+        .path = try writer.add_str("/music"),
+        .first_child = 1,
+        .child_count = 0,
+        .first_file = 0,
+        .file_count = 2,
+    });
+    try writer.add_file("/music/a.mp3", 7, 100, 3, 4, .{ .format = .mp3, .duration_ms = 1000, .title = "A" });
+    try writer.add_file("/music/b.flac", 7, 200, 5, 6, .{ .format = .flac, .artist = "B" });
+    try writer.write(path, "/music", true);
+    return path;
+}
+
+test "an index reads back what was written" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const path = try write_test_index(&tmp);
+    defer std.testing.allocator.free(path);
+    var index = Index.open(path, "/music", true) orelse return error.TestUnexpectedResult;
+    defer index.close();
+    try std.testing.expectEqual(@as(usize, 1), index.dirs.len);
+    try std.testing.expectEqualStrings("/music", index.str(index.dirs[0].path));
+    try std.testing.expectEqual(@as(usize, 0), index.children_of(&index.dirs[0]).len);
+    const files = index.files_of(&index.dirs[0]);
+    try std.testing.expectEqual(@as(usize, 2), files.len);
+    try std.testing.expectEqualStrings("a.mp3", files[0].name(&index));
+    try std.testing.expectEqualStrings("A", index.str(files[0].title));
+    try std.testing.expectEqual(@as(u32, 1000), files[0].duration_ms);
+    const b = index.find_file(&index.dirs[0], "b.flac") orelse return error.TestUnexpectedResult;
+    try std.testing.expectEqualStrings("B", index.str(b.artist));
+    try std.testing.expectEqual(@intFromEnum(tags.Format.flac), b.format);
+    try std.testing.expect(index.find_file(&index.dirs[0], "c.wav") == null);
+}
+
+test "an index of another directory is not opened" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const path = try write_test_index(&tmp);
+    defer std.testing.allocator.free(path);
+    try std.testing.expect(Index.open(path, "/other", true) == null);
+    try std.testing.expect(Index.open(path, "/music", false) == null);
+}
+
+test "a corrupt index is not opened" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const path = try write_test_index(&tmp);
+    defer std.testing.allocator.free(path);
+    var good_buf: [4096]u8 = undefined;
+    const good = try tmp.dir.readFile("test.idx", &good_buf);
+    var bad_buf: [4096]u8 = undefined;
+    const bad = bad_buf[0..good.len];
+    @memcpy(bad, good);
+
+    // sizes that add up past u64.
+    std.mem.writeInt(u64, bad[@offsetOf(Header, "strings_size")..][0..8], std.math.maxInt(u64), .little);
+    try tmp.dir.writeFile(.{ .sub_path = "test.idx", .data = bad });
+    try std.testing.expect(Index.open(path, "/music", true) == null);
+
+    // more records than the file holds.
+    @memcpy(bad, good);
+    std.mem.writeInt(u32, bad[@offsetOf(Header, "file_count")..][0..4], 3, .little);
+    try tmp.dir.writeFile(.{ .sub_path = "test.idx", .data = bad });
+    try std.testing.expect(Index.open(path, "/music", true) == null);
+
+    // truncated.
+    try tmp.dir.writeFile(.{ .sub_path = "test.idx", .data = good[0 .. good.len - 1] });
+    try std.testing.expect(Index.open(path, "/music", true) == null);
+    try tmp.dir.writeFile(.{ .sub_path = "test.idx", .data = good[0 .. @sizeOf(Header) - 1] });
+    try std.testing.expect(Index.open(path, "/music", true) == null);
+
+    // another layout.
+    @memcpy(bad, good);
+    bad[0] = 'X';
+    try tmp.dir.writeFile(.{ .sub_path = "test.idx", .data = bad });
+    try std.testing.expect(Index.open(path, "/music", true) == null);
+}
@@ -1,48 +1,234 @@
 const std = @import("std");
 const common = @import("common.zig");
+const spawn = @import("spawn.zig");
 
 const alloc = std.heap.smp_allocator;
 
+// the library scanner.
+comptime {
+    _ = @import("scan.zig");
+}
+
+// the library watcher.
+comptime {
+    _ = @import("watch.zig");
+}
+
 /// State object of the plugin.
 const State = struct {
-    /// The semaphore.
-    sem_lock: ?*std.c.sem_t,
     /// The shared memory file descriptor.
     shm_fd: ?c_int,
+    /// The shared memory name, unique to this neovim instance.
+    shm_name: [common.shm_name_max]u8,
+    /// Length of the shared memory name.
+    shm_name_len: usize,
     /// The shared memory.
     mem: ?*common.SharedMem,
     /// The child process of the player.
-    proc: ?std.process.Child,
+    /// Cleared once it exits, so liveness checks are a memory read.
+    proc: ?std.posix.pid_t,
+    /// The pidfd of the player process, readable once it exits.
+    pidfd: ?std.posix.fd_t,
     /// The player_cli executable path.
     exe_path: []const u8,
     /// The Log File.
     log_file: std.fs.File,
     /// The log file path name.
     log_file_name: []const u8,
+    /// The volume sent to the player, between 0 - 1.
+    volume: f32,
+    /// The in-progress flag asked for by the last command.
+    in_progress: bool,
+    /// The is-playing flag asked for by the last command.
+    is_playing: bool,
+    /// The rate of tick events in milliseconds, 0 for none.
+    tick_ms: u32,
+    /// The eventfd the player process signals on events.
+    event_fd: ?std.posix.fd_t,
+    /// The eventfd number as passed to the player process.
+    event_fd_arg: [16]u8,
+    /// Flag for using the shared audio daemon instead of an own process.
+    shared: bool,
+    /// The socket to the shared audio daemon.
+    sock_fd: ?std.posix.socket_t,
+    /// The shared audio daemon's status, mapped read-only.
+    daemon_status: ?*common.StatusBlock,
+    /// The last status read in one piece, reported while the block is stuck.
+    last_status: common.Status,
 };
 
 /// The plugin state instance.
 var state: State = .{
-    .sem_lock = null,
     .shm_fd = null,
+    .shm_name = undefined,
+    .shm_name_len = 0,
     .mem = null,
     .proc = null,
+    .pidfd = null,
     .exe_path = undefined,
     .log_file = undefined,
     .log_file_name = undefined,
+    .volume = 0.75,
+    .in_progress = false,
+    .is_playing = false,
+    .tick_ms = 0,
+    .event_fd = null,
+    .event_fd_arg = undefined,
+    .shared = false,
+    .sock_fd = null,
+    .daemon_status = null,
+    .last_status = std.mem.zeroes(common.Status),
 };
 
+/// Time a retired player process gets to exit on its own before it is
+/// killed, in milliseconds.
+const exit_grace_ms: u64 = 1000;
+/// Interval of checking on a retired player process, in milliseconds.
+const reap_interval_ms: u64 = 10;
+
+/// Max number of retired player processes reaped at the same time.
+const max_dying: comptime_int = 4;
+
+/// PIDs of retired player processes that are still being reaped, 0 for a
+/// free slot. The reaper threads clear their slot before the PID is reaped,
+/// so under dying_lock it never names a reused PID.
+var dying_pids: [max_dying]std.posix.pid_t = .{0} ** max_dying;
+/// Guards dying_pids.
+var dying_lock: std.Thread.Mutex = .{};
+
 /// Convenience function to log a message to a file.
 fn log_to_file(comptime fmt: []const u8, args: anytype) void {
     const buf = std.fmt.allocPrint(alloc, fmt, args) catch unreachable;
     _ = state.log_file.write(buf) catch unreachable;
 }
 
-/// Setup the player plugin.
+/// Get the shared memory name of this instance.
+fn get_shm_name() [:0]const u8 {
+    return state.shm_name[0..state.shm_name_len :0];
+}
+
+/// Remove the shared memory left behind by neovim instances that are gone
+/// without cleaning up, e.g. killed or crashed.
+fn remove_stale_shm() void {
+    var dir = std.fs.openDirAbsolute("/dev/shm", .{ .iterate = true }) catch return;
+    defer dir.close();
+    const self_pid = std.c.getpid();
+    var it = dir.iterate();
+    while (it.next() catch null) |entry| {
+        const name = entry.name;
+        if (!std.mem.startsWith(u8, name, common.shm_prefix) or !std.mem.endsWith(u8, name, common.shm_suffix)) {
+            continue;
+        }
+        const pid_str = name[common.shm_prefix.len .. name.len - common.shm_suffix.len];
+        const pid = std.fmt.parseInt(std.posix.pid_t, pid_str, 10) catch continue;
+        if (pid == self_pid) {
+            continue;
+        }
+        // only a controller that no longer exists can not clean up itself.
+        if (std.c.kill(pid, 0) == 0 or std.posix.errno(-1) != .SRCH) {
+            continue;
+        }
+        var buf: [common.shm_name_max]u8 = undefined;
+        const stale = common.shm_name(&buf, pid);
+        if (std.c.shm_unlink(stale) == 0) {
+            log_to_file("removed stale shared memory {s}\n", .{stale});
+        }
+    }
+}
+
+/// Open a pidfd for the player process.
+///
+/// @param pid The PID of the player process.
+/// @return The pidfd, null if the kernel does not support them.
+fn open_pidfd(pid: std.posix.pid_t) ?std.posix.fd_t {
+    const rc = std.os.linux.pidfd_open(pid, 0);
+    return switch (std.os.linux.E.init(rc)) {
+        .SUCCESS => @intCast(rc),
+        else => |err| blk: {
+            log_to_file("pidfd_open failed: {any}\n", .{err});
+            break :blk null;
+        },
+    };
+}
+
+/// Reap a retired player process, killing it if it does not exit in time.
+/// Runs on its own thread so the editor never waits on audio teardown.
+///
+/// @param pid The PID of the player process.
+/// @param pidfd The pidfd of the player process, closed once reaped.
+/// @param slot The slot of the PID in dying_pids, null for none.
+fn reap(pid: std.posix.pid_t, pidfd: ?std.posix.fd_t, slot: ?usize) void {
+    var gone = false;
+    if (pidfd) |fd| {
+        var fds = [_]std.posix.pollfd{.{ .fd = fd, .events = std.posix.POLL.IN, .revents = 0 }};
+        gone = (std.posix.poll(&fds, @intCast(exit_grace_ms)) catch 0) != 0;
+    } else {
+        var waited: u64 = 0;
+        while (!gone and waited < exit_grace_ms) : (waited += reap_interval_ms) {
+            gone = spawn.exited(pid, false);
+            if (!gone) {
+                std.Thread.sleep(reap_interval_ms * std.time.ns_per_ms);
+            }
+        }
+    }
+    if (!gone) {
+        // stuck in a device drain or a backend, it will not exit on its own.
+        std.posix.kill(pid, std.posix.SIG.KILL) catch {};
+    }
+    // wait without reaping, the PID stays ours until the slot is clear.
+    _ = spawn.exited(pid, true);
+    if (slot) |i| {
+        dying_lock.lock();
+        dying_pids[i] = 0;
+        dying_lock.unlock();
+    }
+    if (pidfd) |fd| {
+        std.posix.close(fd);
+    }
+    _ = spawn.wait(pid);
+}
+
+/// Ask the player process to exit and hand it to a background reaper.
+/// Returns right away, the next play may spawn a new player immediately.
+fn retire_player() void {
+    const pid = state.proc orelse return;
+    const pidfd = state.pidfd;
+    state.proc = null;
+    state.pidfd = null;
+    if (!send_command(.quit, null)) {
+        std.posix.kill(pid, std.posix.SIG.KILL) catch |err| {
+            log_to_file("failed to kill proc: {any}.\n", .{err});
+        };
+    }
+    var slot: ?usize = null;
+    dying_lock.lock();
+    for (&dying_pids, 0..) |*dying, i| {
+        if (dying.* == 0) {
+            dying.* = pid;
+            slot = i;
+            break;
+        }
+    }
+    dying_lock.unlock();
+    if (slot == null) {
+        // no slot to find it by, it can not be killed later on.
+        std.posix.kill(pid, std.posix.SIG.KILL) catch {};
+    }
+    const thread = std.Thread.spawn(.{}, reap, .{ pid, pidfd, slot }) catch |err| {
+        // without a thread, only a killed player is quick to wait for.
+        log_to_file("failed to start reaper: {any}.\n", .{err});
+        std.posix.kill(pid, std.posix.SIG.KILL) catch {};
+        reap(pid, pidfd, slot);
+        return;
+    };
+    thread.detach();
+}
+
+/// Setup the log file and the player_cli path.
 ///
 /// @param root_dir The root directory of the plugin.
 /// @return 0 for success, Less than 0 for any error.
-export fn setup(root_dir: [*:0]const u8) c_int {
+fn setup_paths(root_dir: [*:0]const u8) c_int {
     const root: []const u8 = std.mem.span(root_dir);
     const log_file = std.fs.path.join(alloc, &.{
         root,
@@ -67,15 +253,42 @@ export fn setup(root_dir: [*:0]const u8) c_int {
         return -3;
     };
     state.exe_path = exe;
+    return 0;
+}
+
+/// Setup the player plugin.
+///
+/// @param root_dir The root directory of the plugin.
+/// @return 0 for success, Less than 0 for any error.
+export fn setup(root_dir: [*:0]const u8) c_int {
+    const paths = setup_paths(root_dir);
+    if (paths != 0) {
+        return paths;
+    }
+    remove_stale_shm();
+    state.shm_name_len = common.shm_name(&state.shm_name, std.c.getpid()).len;
+    // the name is predictable, so never reuse what is there: drop it and
+    // make a new one only we can open.
+    _ = std.c.shm_unlink(get_shm_name());
     const shm_fd = std.c.shm_open(
-        common.shm_name,
-        common.RDWR | common.CREAT,
+        get_shm_name(),
+        common.RDWR | common.CREAT | common.EXECL,
         std.c.S.IRUSR | std.c.S.IWUSR,
     );
     if (shm_fd == -1) {
         log_to_file("shm_open failed. code({})\n", .{std.posix.errno(-1)});
         return -4;
     }
+    const stat = std.posix.fstat(shm_fd) catch |err| {
+        log_to_file("fstat of the shared memory failed: {any}\n", .{err});
+        _ = std.c.close(shm_fd);
+        return -4;
+    };
+    if (stat.uid != std.c.getuid()) {
+        log_to_file("{s} belongs to another user\n", .{get_shm_name()});
+        _ = std.c.close(shm_fd);
+        return -4;
+    }
     const res: c_int = std.c.ftruncate(shm_fd, @sizeOf(common.SharedMem));
     if (res != 0) {
         log_to_file("ftruncate failed. code({})\n", .{std.posix.errno(-1)});
@@ -98,50 +311,352 @@ export fn setup(root_dir: [*:0]const u8) c_int {
         return -6;
     }
     var mem: *common.SharedMem = @ptrCast(@alignCast(mem_op.?));
-    const sem_lock: ?*std.c.sem_t = std.c.sem_open(
-        common.sem_name,
-        common.CREAT,
-        std.c.S.IRUSR | std.c.S.IWUSR,
-        0,
-    );
-    if (sem_lock == null) {
-        log_to_file("sem_open failed. code({})\n", .{std.posix.errno(-1)});
-        return -7;
-    }
-    mem.length = 0;
-    mem.is_playing = false;
-    mem.should_stop = false;
-    mem.volume = 0.75;
-    mem.playtime = 0;
+    mem.status.init();
+    mem.commands.init();
+    mem.events.init();
+    // spawn hands the eventfd to the player process explicitly.
+    state.event_fd = std.posix.eventfd(0, std.os.linux.EFD.NONBLOCK | std.os.linux.EFD.CLOEXEC) catch |err| blk: {
+        log_to_file("eventfd failed: {any}\n", .{err});
+        break :blk null;
+    };
     state.mem = mem;
     state.shm_fd = shm_fd;
-    state.sem_lock = sem_lock;
     return 0;
 }
 
-/// Play the given audio file.
+/// Setup the player plugin to use the shared audio daemon.
+/// Starts the daemon if no other neovim instance did yet.
 ///
-/// @param file_name The audio filename.
-/// @return 0 for success, Less than 0 for failure.
-export fn play(file_name: [*:0]const u8) c_int {
+/// @param root_dir The root directory of the plugin.
+/// @return 0 for success, Less than 0 for any error.
+export fn setup_shared(root_dir: [*:0]const u8) c_int {
+    const paths = setup_paths(root_dir);
+    if (paths != 0) {
+        return paths;
+    }
+    state.shared = true;
+    if (!connect_daemon()) {
+        return -8;
+    }
+    return 0;
+}
+
+/// Start the shared audio daemon and wait until it listens.
+///
+/// @return True on success, false otherwise.
+fn spawn_daemon() bool {
+    const args: []const []const u8 = &.{
+        state.exe_path,
+        "--daemon",
+        state.log_file_name,
+    };
+    // the daemon outlives this neovim, keep it off our terminal.
+    const pid = spawn.spawn(alloc, args, .{ .quiet = true }) catch |err| {
+        log_to_file("daemon spawn failed: {any}\n", .{err});
+        return false;
+    };
+    // the daemon forks into the background once it listens, so this only
+    // waits for its startup.
+    return spawn.wait(pid) == 0;
+}
+
+/// Map the shared audio daemon's status read-only.
+///
+/// @return True on success, false otherwise.
+fn map_daemon_status() bool {
+    if (state.daemon_status != null) {
+        return true;
+    }
+    var name_buf: [common.shm_name_max]u8 = undefined;
+    const name = common.daemon_shm_name(&name_buf, std.c.getuid());
+    const fd = std.c.shm_open(name, 0, 0);
+    if (fd == -1) {
+        log_to_file("shm_open {s} failed. code({any})\n", .{ name, std.posix.errno(-1) });
+        return false;
+    }
+    defer _ = std.c.close(fd);
+    // the name is predictable, only trust memory the user's own daemon made.
+    const stat = std.posix.fstat(fd) catch return false;
+    if (stat.uid != std.c.getuid()) {
+        log_to_file("{s} belongs to another user\n", .{name});
+        return false;
+    }
+    const mem_op = std.c.mmap(
+        null,
+        @sizeOf(common.StatusBlock),
+        std.c.PROT.READ,
+        .{ .TYPE = .SHARED },
+        fd,
+        0,
+    );
+    if (mem_op == std.c.MAP_FAILED) {
+        log_to_file("mmap of the daemon status failed. code({any})\n", .{std.posix.errno(-1)});
+        return false;
+    }
+    state.daemon_status = @ptrCast(@alignCast(mem_op));
+    return true;
+}
+
+/// Drop the connection to the shared audio daemon.
+fn disconnect_daemon() void {
+    if (state.sock_fd) |fd| {
+        std.posix.close(fd);
+        state.sock_fd = null;
+    }
+    if (state.daemon_status) |status| {
+        _ = std.c.munmap(@ptrCast(@alignCast(status)), @sizeOf(common.StatusBlock));
+        state.daemon_status = null;
+    }
+    // a dead daemon's last words are not the next daemon's status.
+    state.last_status = std.mem.zeroes(common.Status);
+}
+
+/// Connect to the shared audio daemon, starting it if it is not running.
+///
+/// @return True if connected, false otherwise.
+fn connect_daemon() bool {
+    const posix = std.posix;
+    var path_buf: [common.socket_path_max]u8 = undefined;
+    const path = common.daemon_socket_path(&path_buf) orelse {
+        log_to_file("no private directory for the daemon socket\n", .{});
+        return false;
+    };
+    const addr = std.net.Address.initUnix(path) catch return false;
+    var attempt: usize = 0;
+    while (attempt < 2) : (attempt += 1) {
+        const fd = posix.socket(posix.AF.UNIX, posix.SOCK.SEQPACKET | posix.SOCK.CLOEXEC, 0) catch return false;
+        if (posix.connect(fd, &addr.any, addr.getOsSockLen())) {
+            if (!common.peer_is_self(fd)) {
+                log_to_file("the daemon socket {s} belongs to another user\n", .{path});
+                posix.close(fd);
+                return false;
+            }
+            state.sock_fd = fd;
+            if (!map_daemon_status()) {
+                disconnect_daemon();
+                return false;
+            }
+            // the daemon keeps its volume across clients, the tick rate is
+            // the last one any client asked for.
+            _ = send_wire(.volume, null);
+            _ = send_wire(.tick, null);
+            return true;
+        } else |_| {
+            posix.close(fd);
+        }
+        if (attempt == 0 and !spawn_daemon()) {
+            return false;
+        }
+    }
+    log_to_file("failed to connect to the daemon at {s}\n", .{path});
+    return false;
+}
+
+/// Outcome of sending a command to the shared audio daemon.
+const WireResult = enum {
+    sent,
+    /// The daemon is alive but the command was not sent, like a full ring.
+    dropped,
+    /// The connection is gone.
+    gone,
+};
+
+/// Send a command to the shared audio daemon.
+/// Never blocks, a daemon not reading its socket is treated like a player
+/// not draining its ring.
+///
+/// @param command The command.
+/// @param path The file argument of the command, if any.
+/// @return The outcome.
+fn send_wire(command: common.Command, path: ?[]const u8) WireResult {
+    const fd = state.sock_fd orelse return .gone;
+    const p = path orelse "";
+    if (p.len >= common.path_max) {
+        return .dropped;
+    }
+    var message: [common.wire_max]u8 align(@alignOf(common.WireCommand)) = undefined;
+    const header: *common.WireCommand = @ptrCast(&message);
+    header.* = .{
+        .command = @intFromEnum(command),
+        .reserved = .{ 0, 0, 0 },
+        .volume = state.volume,
+        .tick_ms = state.tick_ms,
+        .path_len = @intCast(p.len),
+    };
+    @memcpy(message[@sizeOf(common.WireCommand)..][0..p.len], p);
+    const len = @sizeOf(common.WireCommand) + p.len;
+    _ = std.posix.send(fd, message[0..len], std.posix.MSG.DONTWAIT | std.posix.MSG.NOSIGNAL) catch |err| {
+        log_to_file("failed to send to the daemon: {any}\n", .{err});
+        return if (err == error.WouldBlock) .dropped else .gone;
+    };
+    return .sent;
+}
+
+/// Flag for a player to send commands to, own process or shared daemon.
+fn running() bool {
+    return state.proc != null or state.sock_fd != null;
+}
+
+/// Start the player process if it is not running yet.
+/// The process stays alive across songs so its audio device stays warm.
+///
+/// @return True if the process is running, false otherwise.
+fn ensure_player() bool {
+    if (state.shared) {
+        return state.sock_fd != null or connect_daemon();
+    }
     if (state.proc != null) {
-        stop();
-        state.proc = null;
+        return true;
     }
+    // the eventfd shows up as spawn.inherit_fd in the player process.
+    const child_fd: std.posix.fd_t = if (state.event_fd != null) spawn.inherit_fd else -1;
+    const fd_arg = std.fmt.bufPrint(&state.event_fd_arg, "{d}", .{child_fd}) catch unreachable;
     const args: []const []const u8 = &.{
         state.exe_path,
-        std.mem.span(file_name),
+        get_shm_name(),
         state.log_file_name,
+        fd_arg,
     };
     if (state.mem) |mem| {
-        mem.is_playing = true;
-        mem.should_stop = false;
-        state.proc = std.process.Child.init(args, alloc);
-        state.proc.?.spawn() catch |err| {
+        dying_lock.lock();
+        for (dying_pids) |dying| {
+            if (dying != 0) {
+                // a retired player that is still around must not pick up
+                // the new player's commands from the shared ring.
+                std.posix.kill(dying, std.posix.SIG.KILL) catch {};
+            }
+        }
+        dying_lock.unlock();
+        // the old player may have died inside a status update.
+        mem.status.init();
+        mem.commands.init();
+        mem.events.init();
+        state.last_status = std.mem.zeroes(common.Status);
+        // posix_spawn, so a large editor heap is not copied for a fork.
+        state.proc = spawn.spawn(alloc, args, .{ .inherit = state.event_fd }) catch |err| {
             log_to_file("spawn failed: {any}\n", .{err});
-            mem.is_playing = false;
-            return -1;
+            return false;
         };
+        state.pidfd = open_pidfd(state.proc.?);
+        // the new process starts at full volume without ticks, send it the
+        // current settings.
+        _ = send_command(.volume, null);
+        _ = send_command(.tick, null);
+        return true;
+    }
+    return false;
+}
+
+/// Start the player ahead of the first play.
+/// The player opens its audio context and device right away, then sleeps on
+/// the command ring without using CPU until a song is sent. The device only
+/// starts playing with the first song.
+///
+/// @return 0 for success, Less than 0 for failure.
+export fn prespawn() c_int {
+    if (!ensure_player()) {
+        return -1;
+    }
+    return 0;
+}
+
+/// Send a command to the player process.
+///
+/// @param command The command.
+/// @param file_name The file argument of the command, if any.
+/// @return True if the command was sent, false otherwise.
+fn send_command(command: common.Command, file_name: ?[*:0]const u8) bool {
+    var path: ?[]const u8 = null;
+    if (file_name) |name| {
+        path = std.mem.span(name);
+    }
+    if (state.shared) {
+        switch (send_wire(command, path)) {
+            .sent => return true,
+            // the caller reports it, like a full ring.
+            .dropped => return false,
+            .gone => {},
+        }
+        // the daemon went away, start a new one and try once more.
+        disconnect_daemon();
+        return command != .quit and connect_daemon() and send_wire(command, path) == .sent;
+    }
+    const mem = state.mem orelse return false;
+    switch (command) {
+        // only the latest value matters, they never need a ring slot.
+        .volume, .tick => mem.commands.set_settings(state.volume, state.tick_ms),
+        else => if (mem.commands.push(command, state.volume, state.tick_ms, path) == null) {
+            // the player is not draining the ring, the caller reports it.
+            log_to_file("failed to send command {s}: ring full or path too long.\n", .{@tagName(command)});
+            mem.commands.wake();
+            return false;
+        },
+    }
+    mem.commands.wake();
+    return true;
+}
+
+/// Read a status block, falling back to the last good snapshot when a
+/// writer died holding it.
+///
+/// @param block The status block.
+/// @return The status.
+fn read_block(block: *common.StatusBlock) common.Status {
+    if (block.read()) |status| {
+        state.last_status = status;
+        return status;
+    }
+    return state.last_status;
+}
+
+/// Get a consistent snapshot of the player status.
+/// While commands are still on their way, the states they ask for are
+/// reported so the UI follows the user right away.
+fn read_status() common.Status {
+    var status = std.mem.zeroes(common.Status);
+    if (state.daemon_status) |block| {
+        // shared by every client, nothing of ours to overlay.
+        return read_block(block);
+    }
+    if (!running()) {
+        return status;
+    }
+    const mem = state.mem orelse return status;
+    status = read_block(&mem.status);
+    if (mem.commands.pending() != 0) {
+        status.in_progress = @intFromBool(state.in_progress);
+        status.is_playing = @intFromBool(state.in_progress and state.is_playing);
+    }
+    return status;
+}
+
+/// Play the given audio file.
+///
+/// @param file_name The audio filename.
+/// @return 0 for success, Less than 0 for failure.
+export fn play(file_name: [*:0]const u8) c_int {
+    if (!ensure_player()) {
+        return -1;
+    }
+    state.in_progress = true;
+    state.is_playing = true;
+    if (!send_command(.load, file_name)) {
+        return -2;
+    }
+    return 0;
+}
+
+/// Enqueue the given audio file to play once the current one ends.
+/// Plays it right away if nothing is playing.
+///
+/// @param file_name The audio filename.
+/// @return 0 for success, Less than 0 for failure.
+export fn enqueue(file_name: [*:0]const u8) c_int {
+    if (!ensure_player()) {
+        return -1;
+    }
+    if (!send_command(.enqueue, file_name)) {
+        return -2;
     }
     return 0;
 }
@@ -150,95 +665,150 @@ export fn play(file_name: [*:0]const u8) c_int {
 ///
 /// @param vol The volume. Value must be between 0 - 1.
 export fn set_volume(vol: f32) void {
-    if (state.proc == null) {
+    state.volume = vol;
+    if (!running()) {
         return;
     }
-    if (state.mem) |mem| {
-        mem.volume = vol;
-        if (state.sem_lock) |sem_lock| {
-            _ = std.c.sem_post(sem_lock);
-        }
-    }
+    _ = send_command(.volume, null);
 }
 
 /// Pause the player.
-export fn pause() void {
-    if (state.proc == null) {
-        return;
+///
+/// @return 0 for success, Less than 0 if the command could not be sent.
+export fn pause() c_int {
+    if (!running()) {
+        return 0;
     }
-    if (state.mem) |mem| {
-        mem.is_playing = false;
-        if (state.sem_lock) |sem_lock| {
-            _ = std.c.sem_post(sem_lock);
-        }
+    state.in_progress = read_status().in_progress != 0;
+    state.is_playing = false;
+    if (!send_command(.pause, null)) {
+        return -1;
     }
+    return 0;
 }
 
 /// Resume the player.
-export fn @"resume"() void {
-    if (state.proc == null) {
-        return;
+///
+/// @return 0 for success, Less than 0 if the command could not be sent.
+export fn @"resume"() c_int {
+    if (!running()) {
+        return 0;
     }
-    if (state.mem) |mem| {
-        mem.is_playing = true;
-        if (state.sem_lock) |sem_lock| {
-            _ = std.c.sem_post(sem_lock);
-        }
+    state.in_progress = read_status().in_progress != 0;
+    state.is_playing = true;
+    if (!send_command(.@"resume", null)) {
+        return -1;
     }
+    return 0;
 }
 
 /// Stop the player.
 /// This function will clear the song from the player.
-export fn stop() void {
-    if (state.proc == null) {
+///
+/// @return 0 for success, Less than 0 if the command could not be sent.
+export fn stop() c_int {
+    if (!running()) {
+        return 0;
+    }
+    state.in_progress = false;
+    state.is_playing = false;
+    if (!send_command(.stop, null)) {
+        return -1;
+    }
+    return 0;
+}
+
+/// Set the rate of position tick events while playing.
+///
+/// @param ms The rate in milliseconds, 0 for no ticks.
+export fn set_tick(ms: u32) void {
+    state.tick_ms = ms;
+    if (!running()) {
         return;
     }
+    _ = send_command(.tick, null);
+}
+
+/// Get the eventfd that becomes readable when the player has events.
+/// With the shared daemon this is the socket to it.
+///
+/// @return The file descriptor, -1 if there is none.
+export fn get_event_fd() c_int {
+    if (state.shared) {
+        return state.sock_fd orelse -1;
+    }
+    return state.event_fd orelse -1;
+}
+
+/// Pop the next event from the player.
+/// Clears the eventfd once every event was read.
+///
+/// @param out The event.
+/// @return 1 if there was an event, 0 otherwise, -1 if the shared daemon
+///  went away and the fd will not deliver events anymore.
+export fn next_event(out: *common.Event) c_int {
+    if (state.shared) {
+        const fd = state.sock_fd orelse return -1;
+        const len = std.posix.recv(fd, std.mem.asBytes(out), std.posix.MSG.DONTWAIT) catch |err| switch (err) {
+            error.WouldBlock => return 0,
+            else => return -1,
+        };
+        return if (len == @sizeOf(common.Event)) 1 else -1;
+    }
+    const mem = state.mem orelse return 0;
+    if (mem.events.pop()) |event| {
+        out.* = event;
+        return 1;
+    }
+    // clear the eventfd, then check again for an event pushed in between.
+    if (state.event_fd) |fd| {
+        var count: u64 = 0;
+        _ = std.posix.read(fd, std.mem.asBytes(&count)) catch {};
+    }
+    if (mem.events.pop()) |event| {
+        out.* = event;
+        return 1;
+    }
+    return 0;
+}
+
+/// Get the amount of commands the player process has not applied yet.
+export fn pending_commands() u32 {
     if (state.mem) |mem| {
-        mem.should_stop = true;
-        if (state.sem_lock) |sem_lock| {
-            _ = std.c.sem_post(sem_lock);
-        }
-        if (state.proc) |*proc| {
-            _ = proc.*.wait() catch |err| {
-                log_to_file("failed to wait proc: {any}.\n", .{err});
-            };
-        }
+        return mem.commands.pending();
     }
+    return 0;
 }
 
 /// Get the current playtime of the running audio in seconds.
 export fn get_playtime() f64 {
-    if (state.proc == null) {
+    if (!running()) {
         return 0;
     }
-    if (state.mem) |mem| {
-        return mem.playtime;
+    // the player publishes whole frames, only convert them here.
+    const status = read_status();
+    if (status.sample_rate == 0) {
+        return 0;
     }
-    return 0;
+    return @as(f64, @floatFromInt(status.frames)) / @as(f64, @floatFromInt(status.sample_rate));
 }
 
 /// Get the total audio length in seconds.
 export fn get_audio_length() u64 {
-    if (state.proc == null) {
+    if (!running()) {
         return 0;
     }
-    if (state.mem) |mem| {
-        return mem.length;
-    }
-    return 0;
+    return read_status().length;
 }
 
 /// Get the is-playing flag.
 ///
 /// @return 1 for true, 0 for false.
 export fn is_playing() c_int {
-    if (state.proc == null) {
+    if (!running()) {
         return 0;
     }
-    if (state.mem) |mem| {
-        return @intFromBool(mem.is_playing);
-    }
-    return 0;
+    return read_status().is_playing;
 }
 
 /// Get the in-progress flag.
@@ -247,39 +817,107 @@ export fn is_playing() c_int {
 ///
 /// @return 1 for true, 0 for false.
 export fn in_progress() c_int {
-    if (state.proc == null) {
+    if (!running()) {
         return 0;
     }
-    // sending 0 to id with kill just checks to see if the process exists
-    // and we have permission to kill it. We don't need to worry about permissions
-    if (std.c.kill(state.proc.?.id, 0) == 0) {
-        return 1;
+    // the player process outlives the song, so ask it instead.
+    return read_status().in_progress;
+}
+
+/// Get a consistent snapshot of the player status in one call.
+///
+/// @param out The status.
+/// @return 1 if a player process is running, 0 otherwise.
+export fn get_status(out: *common.Status) c_int {
+    out.* = read_status();
+    return @intFromBool(running());
+}
+
+/// Get the pidfd of the player process.
+/// It becomes readable when the player process exits, e.g. on a crash,
+/// then call player_exited. Stop polling it before kill_player or deinit,
+/// which close it.
+///
+/// @return The file descriptor, -1 if there is none.
+export fn get_player_fd() c_int {
+    return state.pidfd orelse -1;
+}
+
+/// Reap the player process after its pidfd became readable.
+/// Closes the pidfd, so stop polling it first.
+///
+/// @return 1 if the player process exited and was reaped, 0 if it still runs.
+export fn player_exited() c_int {
+    const pid = state.proc orelse return 0;
+    const linux = std.os.linux;
+    // raw waitid, std.posix.waitpid treats ECHILD as unreachable.
+    var info = std.mem.zeroes(linux.siginfo_t);
+    const rc = if (state.pidfd) |fd|
+        linux.waitid(.PIDFD, fd, &info, linux.W.EXITED | linux.W.NOHANG)
+    else
+        linux.waitid(.PID, pid, &info, linux.W.EXITED | linux.W.NOHANG);
+    switch (linux.E.init(rc)) {
+        // a child still running leaves the info zeroed.
+        .SUCCESS => if (info.signo == 0) {
+            return 0;
+        },
+        // already reaped, it is gone all the same.
+        .CHILD => {},
+        else => |err| {
+            log_to_file("waitid failed: {any}\n", .{err});
+            return 0;
+        },
     }
-    return 0;
+    log_to_file("player process exited: code({d})\n", .{info.code});
+    state.proc = null;
+    if (state.pidfd) |fd| {
+        std.posix.close(fd);
+        state.pidfd = null;
+    }
+    state.in_progress = false;
+    state.is_playing = false;
+    return 1;
+}
+
+/// Stop the player process without waiting for it to exit.
+/// The plugin stays setup, the next play starts a new player process.
+export fn kill_player() void {
+    if (state.shared) {
+        // the daemon belongs to every client, only drop the song.
+        _ = stop();
+        return;
+    }
+    retire_player();
+    state.in_progress = false;
+    state.is_playing = false;
 }
 
 /// Deinitialize the player plugin.
+/// Does not wait for the player process, it exits on its own.
 export fn deinit() void {
     alloc.free(state.log_file_name);
     alloc.free(state.exe_path);
-    if (state.proc) |*proc| {
-        _ = proc.*.kill() catch |err| {
-            log_to_file("failed to kill proc: {any}.\n", .{err});
-        };
-    }
-    if (state.sem_lock) |sem_lock| {
-        _ = std.c.sem_close(sem_lock);
-        _ = std.c.sem_destroy(sem_lock);
+    retire_player();
+    if (state.shared) {
+        // leave the daemon running for the other clients.
+        _ = send_wire(.quit, null);
+        disconnect_daemon();
     }
     if (state.mem) |mem| {
         const result = std.c.munmap(@ptrCast(@alignCast(mem)), @sizeOf(common.SharedMem));
         if (result != 0) {
             log_to_file("munmap failed: code({})\n", .{result});
         }
+        state.mem = null;
+    }
+    if (state.event_fd) |fd| {
+        std.posix.close(fd);
+        state.event_fd = null;
     }
     if (state.shm_fd) |shm_fd| {
-        _ = std.c.shm_unlink(common.shm_name);
+        _ = std.c.shm_unlink(get_shm_name());
         _ = std.c.close(shm_fd);
+        state.shm_fd = null;
     }
     state.log_file.close();
 }
@@ -4,14 +4,14 @@ const common = @import("common.zig");
 
 /// Error values.
 const Error = error {
-    /// Missing the param for the CLI
-    missing_param,
+    /// No shared memory name was given.
+    missing_shm_name,
     /// Shared Memory acquire failed.
     shm_failed,
-    /// Semaphore open failed.
-    sem_open_failed,
-    /// Semaphore wait failed.
-    sem_wait_failed,
+    /// Waiting for commands failed.
+    wait_failed,
+    /// No socket path for the shared daemon.
+    socket_path_failed,
 };
 
 const alloc = std.heap.smp_allocator;
@@ -19,22 +19,41 @@ const alloc = std.heap.smp_allocator;
 var log_file: ?std.fs.File = null;
 /// The shared memory object.
 var mem: ?*common.SharedMem = null;
-/// The semaphore value.
-var sem_lock: ?*std.c.sem_t = null;
+/// The status the player publishes, in mem or in the daemon's own memory.
+var status_block: ?*common.StatusBlock = null;
+/// The eventfd the plugin polls for events, null if none.
+var event_fd: ?std.posix.fd_t = null;
+/// The eventfd the daemon loop polls for the end of a song, null if none.
+var end_fd: ?std.posix.fd_t = null;
+
+/// Max clients of the shared daemon.
+const max_clients: comptime_int = 64;
+/// Sockets of the clients connected to the shared daemon.
+var clients: [max_clients]std.posix.socket_t = undefined;
+/// Amount of connected clients.
+var client_count: usize = 0;
 
 /// Playback callback
-export fn playback_cb(elapsed_time: f64, ended: bool) void {
+export fn playback_cb(position: u64, ended: bool) void {
     if (ended) {
-        if (sem_lock) |sl| {
-            // unblock our main thread if the audio has ended.
-            const result: c_int = std.c.sem_post(sl);
-            if (result != 0) {
-                log_to_file("playback_cli: sem_post on playback end failed: code({})\n", .{std.posix.errno(-1)});
-            }
+        // wake up our main thread so it can mark the song as done.
+        if (mem) |m| {
+            m.commands.wake();
+        }
+        if (end_fd) |fd| {
+            const one: u64 = 1;
+            _ = std.posix.write(fd, std.mem.asBytes(&one)) catch {};
         }
     } else {
-        if (mem) |m| {
-            m.playtime += elapsed_time;
+        if (status_block) |block| {
+            // never wait on the audio thread, the next period catches up.
+            if (block.tryLock()) |current| {
+                var status = current;
+                status.frames = position;
+                // the length changes when an enqueued song starts.
+                status.length = player.get_audio_length();
+                block.unlock(status);
+            }
         }
     }
 }
@@ -49,32 +68,194 @@ fn log_to_file(comptime fmt: []const u8, args: anytype) void {
     std.log.info(fmt, args);
 }
 
+/// Send an event to the plugin.
+///
+/// @param kind The kind of event.
+fn emit(kind: common.EventKind) void {
+    const event: common.Event = .{
+        .kind = @intFromEnum(kind),
+        .reserved = .{ 0, 0, 0 },
+        .sample_rate = player.get_sample_rate(),
+        .frames = player.get_position(),
+    };
+    // every client of the shared daemon gets its own copy.
+    for (clients[0..client_count]) |client| {
+        _ = std.posix.send(client, std.mem.asBytes(&event), std.posix.MSG.DONTWAIT | std.posix.MSG.NOSIGNAL) catch {};
+    }
+    const m = mem orelse return;
+    const fd = event_fd orelse return;
+    if (!m.events.push(event)) {
+        // the plugin has not read the older events yet, so it will wake up
+        // for them anyway.
+        return;
+    }
+    const one: u64 = 1;
+    _ = std.posix.write(fd, std.mem.asBytes(&one)) catch |err| {
+        log_to_file("failed to signal event: {any}\n", .{err});
+    };
+}
+
+/// Local copy of the states applied to the player.
+const Applied = struct {
+    /// Flag for if a song is loaded.
+    in_progress: bool,
+    /// Flag for if the player is playing.
+    is_playing: bool,
+    /// The applied volume.
+    volume: f32,
+    /// The rate of tick events in milliseconds, 0 for none.
+    tick_ms: u32,
+};
+
+/// Publish the applied states to the plugin in one update.
+///
+/// @param block The status to publish to.
+/// @param applied The states applied to the player.
+fn publish_status(block: *common.StatusBlock, applied: *const Applied) void {
+    var status = block.lock();
+    status.in_progress = @intFromBool(applied.in_progress);
+    status.is_playing = @intFromBool(applied.in_progress and applied.is_playing);
+    if (applied.in_progress) {
+        status.sample_rate = player.get_sample_rate();
+        status.length = player.get_audio_length();
+        status.frames = player.get_position();
+    } else {
+        status.frames = 0;
+        status.length = 0;
+    }
+    block.unlock(status);
+}
+
+/// Run a load, enqueue or stop command.
+///
+/// @param applied The states applied to the player.
+/// @param cmd The command.
+fn run_command(applied: *Applied, cmd: *const common.CommandSlot) void {
+    const path: [*:0]const u8 = @ptrCast(&cmd.path);
+    switch (cmd.command) {
+        .load => {
+            if (player.sync.play(path) == 0) {
+                log_to_file("failed to play song.\n", .{});
+                applied.in_progress = false;
+                applied.is_playing = false;
+                emit(.@"error");
+                return;
+            }
+            applied.in_progress = true;
+            applied.is_playing = true;
+            emit(.started);
+        },
+        .enqueue => {
+            if (player.sync.enqueue_next(path) == 0) {
+                log_to_file("failed to enqueue song.\n", .{});
+                emit(.@"error");
+                return;
+            }
+            if (!applied.in_progress) {
+                // nothing was playing, so the song started right away.
+                applied.in_progress = true;
+                applied.is_playing = true;
+                emit(.started);
+            }
+        },
+        .stop => {
+            _ = player.sync.stop();
+            applied.in_progress = false;
+            applied.is_playing = false;
+        },
+        else => {},
+    }
+}
+
+/// Apply a batch of commands, coalescing the redundant ones.
+///
+/// @param applied The states applied to the player.
+/// @param batch The commands in the order they were sent.
+/// @return True if the player process should exit.
+fn run_batch(applied: *Applied, batch: []const common.CommandSlot) bool {
+    // the last load or stop replaces every song command before it, and only
+    // the last volume matters.
+    var start: usize = 0;
+    var volume: ?f32 = null;
+    for (batch, 0..) |*cmd, i| {
+        switch (cmd.command) {
+            .load, .stop => start = i,
+            .volume => volume = cmd.volume,
+            .tick => applied.tick_ms = cmd.tick_ms,
+            .quit => return true,
+            else => {},
+        }
+    }
+    // pause and resume only matter by the state they end up in.
+    var playing: ?bool = null;
+    for (batch[start..]) |*cmd| {
+        switch (cmd.command) {
+            .pause => playing = false,
+            .@"resume" => playing = true,
+            .load, .enqueue, .stop => run_command(applied, cmd),
+            else => {},
+        }
+    }
+    if (volume) |vol| {
+        if (vol != applied.volume) {
+            applied.volume = vol;
+            player.set_volume(vol);
+        }
+    }
+    if (playing) |flag| {
+        if (applied.in_progress and flag != applied.is_playing) {
+            applied.is_playing = flag;
+            if (flag) {
+                player.sync.@"resume"();
+            } else {
+                player.sync.pause();
+            }
+        }
+    }
+    return false;
+}
+
 pub fn main() !void {
     var args = std.process.args();
     defer args.deinit();
-    if (!args.skip()) {
-        std.log.err("A filename of the song to play is a required parameter.\n", .{});
-        return Error.missing_param;
-    }
-    // song file name
-    const file_name: ?[:0]const u8 = args.next();
-    if (file_name == null) {
-        std.log.err("A filename of the song to play is a required parameter.\n", .{});
-        return Error.missing_param;
-    }
+    _ = args.skip();
 
+    // shared memory of the controller that spawned us.
+    const shm_name: [:0]const u8 = args.next() orelse {
+        std.log.err("usage: player_cli <shm name> [log file] [event fd]\n", .{});
+        std.log.err("       player_cli --daemon [log file]\n", .{});
+        return Error.missing_shm_name;
+    };
+    if (std.mem.eql(u8, shm_name, "--daemon")) {
+        if (args.next()) |log_fn| {
+            log_file = try std.fs.openFileAbsoluteZ(log_fn, .{.mode = .read_write});
+        }
+        return serve();
+    }
+    // exit with the controller, a player it can no longer reach is useless.
+    _ = std.posix.prctl(.SET_PDEATHSIG, .{std.posix.SIG.TERM}) catch {};
     // optional log file
     const log_file_name: ?[:0]const u8 = args.next();
     if (log_file_name) |log_fn| {
         log_file = try std.fs.openFileAbsoluteZ(log_fn, .{.mode = .read_write});
     }
+    // optional eventfd inherited from the plugin.
+    if (args.next()) |fd_arg| {
+        event_fd = std.fmt.parseInt(std.posix.fd_t, fd_arg, 10) catch null;
+    }
 
     // get our shared memory file descriptor
     const shm_fd = std.c.shm_open(
-        common.shm_name,
+        shm_name,
         common.RDWR, // read/write
         std.c.S.IRUSR | std.c.S.IWUSR,
     );
+    if (shm_fd == -1) {
+        log_to_file("player_cli: shm_open {s} failed: code({any})\n", .{ shm_name, std.posix.errno(-1) });
+        return Error.shm_failed;
+    }
+    // the mapping keeps the memory alive.
+    defer _ = std.c.close(shm_fd);
     const mapping: std.c.MAP = .{
         .TYPE = .SHARED,
     };
@@ -92,72 +273,317 @@ pub fn main() !void {
         return Error.shm_failed;
     }
     mem = @ptrCast(@alignCast(mem_op.?));
-    // local memory copy
-    var local_mem: common.SharedMem = undefined;
-    if (mem) |m| {
-        local_mem = .{
-            .is_playing = m.is_playing,
-            .volume = m.volume,
-            .should_stop = m.should_stop,
-            .length = 0,
-            .playtime = 0,
-        };
-        // reset playtime
-        m.playtime = 0;
-    }
-    // acquire the shared semaphore
-    sem_lock = std.c.sem_open(common.sem_name, 0, 0, 0);
-    if (sem_lock == null) {
-        log_to_file("sem_open failed: code({})\n", .{std.posix.errno(-1)});
-        return  Error.sem_open_failed;
-    }
-    defer _ = std.c.sem_close(sem_lock.?);
-    // setup player
-    player.setup(playback_cb);
-    defer player.deinit();
-    // play the song.
-    if (player.play(file_name.?) == 0) {
-        log_to_file("failed to play song.\n", .{});
+    status_block = &mem.?.status;
+    // the states applied to the player.
+    var applied: Applied = .{
+        .in_progress = false,
+        .is_playing = false,
+        .volume = 1.0,
+        .tick_ms = 0,
+    };
+    // setup the player once, the device stays warm across songs.
+    if (player.setup(playback_cb) == 0) {
+        log_to_file("failed to setup player.\n", .{});
         return;
     }
-    if (mem) |m| {
-        // set the volume to whatever is set.
-        player.set_volume(local_mem.volume);
-        // set audio length.
-        m.length = player.get_audio_length();
-        local_mem.length = m.length;
-    }
-
-    // main loop
-    while (player.has_stopped() != 1) {
-        // block until controller sends an update.
-        if (sem_lock) |sl| {
-            // wait for semaphore update
-            const wait_res: c_int = std.c.sem_wait(sl);
-            if (wait_res != 0) {
-                log_to_file("failed to sem_wait: {any}\n", .{std.posix.errno(-1)});
-                return Error.sem_wait_failed;
+    defer player.deinit();
+    // commands are applied in batches, one batch per wakeup.
+    var batch: [common.ring_size]common.CommandSlot = undefined;
+
+    // main loop, runs until the plugin asks the process to exit.
+    const m = mem.?;
+    const ring = &m.commands;
+    while (true) {
+        var count: usize = 0;
+        while (count < batch.len) : (count += 1) {
+            const cmd = ring.peek() orelse break;
+            batch[count] = cmd.*;
+            ring.pop();
+        }
+        const quit = run_batch(&applied, batch[0..count]);
+        if (ring.take_settings()) |settings| {
+            const vol: f32 = @bitCast(settings.volume);
+            if (vol != applied.volume) {
+                applied.volume = vol;
+                player.set_volume(vol);
             }
+            applied.tick_ms = settings.tick_ms;
+        }
+        if (count > 0) {
+            publish_status(&m.status, &applied);
+        }
+        // acknowledge after publishing, so the plugin never sees an acked
+        // command with an older status.
+        ring.ack();
+        if (quit) {
+            _ = player.sync.stop();
+            break;
+        }
+        if (count == batch.len) {
+            // the ring may hold more, drain it before sleeping.
+            continue;
+        }
+        if (applied.in_progress and player.has_stopped() == 1) {
+            // the song has ended, stay around for the next one.
+            applied.in_progress = false;
+            applied.is_playing = false;
+            publish_status(&m.status, &applied);
+            emit(.ended);
+            // stop the device too, so the waiting player uses no CPU.
+            _ = player.sync.stop();
+        }
+        // block until controller sends an update, waking up for ticks only
+        // while playing.
+        const ticking = applied.in_progress and applied.is_playing and applied.tick_ms > 0;
+        const timeout: ?u32 = if (ticking) applied.tick_ms else null;
+        const result = ring.wait(timeout) catch |err| {
+            log_to_file("failed to wait for commands: {any}\n", .{err});
+            return Error.wait_failed;
+        };
+        if (result == .timed_out) {
+            emit(.tick);
         }
+    }
+}
 
-        if (mem) |m| {
-            // check for updated states and apply them
-            if (m.is_playing != local_mem.is_playing) {
-                local_mem.is_playing = m.is_playing;
-                if (local_mem.is_playing) {
-                    player.@"resume"();
-                } else {
-                    player.pause();
-                }
+/// Bind the shared daemon's listening socket.
+///
+/// @param path The socket path.
+/// @return The socket, null if another daemon already listens on it.
+fn listen_socket(path: []const u8) !?std.posix.socket_t {
+    const posix = std.posix;
+    const addr = try std.net.Address.initUnix(path);
+    const fd = try posix.socket(posix.AF.UNIX, posix.SOCK.SEQPACKET | posix.SOCK.CLOEXEC, 0);
+    errdefer posix.close(fd);
+    posix.bind(fd, &addr.any, addr.getOsSockLen()) catch |err| switch (err) {
+        error.AddressInUse => {
+            // a live daemon answers, the socket file of a dead one does not.
+            const probe = try posix.socket(posix.AF.UNIX, posix.SOCK.SEQPACKET | posix.SOCK.CLOEXEC, 0);
+            defer posix.close(probe);
+            if (posix.connect(probe, &addr.any, addr.getOsSockLen())) {
+                posix.close(fd);
+                return null;
+            } else |_| {}
+            posix.unlink(path) catch {};
+            try posix.bind(fd, &addr.any, addr.getOsSockLen());
+        },
+        else => return err,
+    };
+    posix.fchmodat(posix.AT.FDCWD, path, 0o600, 0) catch {};
+    try posix.listen(fd, 16);
+    return fd;
+}
+
+/// Accept a client of the shared daemon.
+///
+/// @param listener The listening socket.
+fn accept_client(listener: std.posix.socket_t) void {
+    const posix = std.posix;
+    const client = posix.accept(listener, null, null, posix.SOCK.CLOEXEC | posix.SOCK.NONBLOCK) catch |err| {
+        log_to_file("daemon: accept failed: {any}\n", .{err});
+        return;
+    };
+    if (!common.peer_is_self(client)) {
+        log_to_file("daemon: refused a client of another user.\n", .{});
+        posix.close(client);
+        return;
+    }
+    if (client_count == max_clients) {
+        log_to_file("daemon: too many clients.\n", .{});
+        posix.close(client);
+        return;
+    }
+    clients[client_count] = client;
+    client_count += 1;
+}
+
+/// Disconnect a client of the shared daemon.
+///
+/// @param index The index of the client.
+fn remove_client(index: usize) void {
+    std.posix.close(clients[index]);
+    client_count -= 1;
+    clients[index] = clients[client_count];
+}
+
+/// Read the pending commands of a client into the batch.
+///
+/// @param client The client socket.
+/// @param batch The batch to append to.
+/// @param count The amount of commands in the batch, updated.
+/// @return False if the client left.
+fn read_client(client: std.posix.socket_t, batch: []common.CommandSlot, count: *usize) bool {
+    const posix = std.posix;
+    var message: [common.wire_max]u8 align(@alignOf(common.WireCommand)) = undefined;
+    while (count.* < batch.len) {
+        const len = posix.recv(client, &message, posix.MSG.DONTWAIT) catch |err| switch (err) {
+            error.WouldBlock => return true,
+            else => return false,
+        };
+        if (len == 0) {
+            return false;
+        }
+        if (len < @sizeOf(common.WireCommand)) {
+            continue;
+        }
+        const header: *const common.WireCommand = @ptrCast(&message);
+        if (header.command > @intFromEnum(common.Command.quit) or
+            header.path_len >= common.path_max or
+            len != @sizeOf(common.WireCommand) + header.path_len)
+        {
+            log_to_file("daemon: dropped a malformed command.\n", .{});
+            continue;
+        }
+        const command: common.Command = @enumFromInt(header.command);
+        if (command == .quit) {
+            // the client is going away, the daemon stays for the others.
+            return false;
+        }
+        const slot = &batch[count.*];
+        slot.command = command;
+        slot.volume = header.volume;
+        slot.tick_ms = header.tick_ms;
+        const path = message[@sizeOf(common.WireCommand)..len];
+        @memcpy(slot.path[0..path.len], path);
+        slot.path[path.len] = 0;
+        count.* += 1;
+    }
+    return true;
+}
+
+/// Run as the shared audio daemon.
+/// One daemon owns the audio device for every neovim instance of the user.
+/// Clients send commands over a unix socket, receive events on it and read
+/// the status from a read-only mapping, so more clients cost the audio
+/// process nothing per status update.
+/// Exits once the last client disconnects.
+fn serve() !void {
+    const posix = std.posix;
+    var path_buf: [common.socket_path_max]u8 = undefined;
+    const path = common.daemon_socket_path(&path_buf) orelse return Error.socket_path_failed;
+    const listener = (try listen_socket(path)) orelse {
+        log_to_file("daemon: already running.\n", .{});
+        return;
+    };
+    defer {
+        posix.close(listener);
+        posix.unlink(path) catch {};
+    }
+    // the status memory, only the daemon writes to it.
+    var name_buf: [common.shm_name_max]u8 = undefined;
+    const shm_name = common.daemon_shm_name(&name_buf, std.c.getuid());
+    // holding the socket makes this the only daemon, so an existing object
+    // is a leftover of a dead one. One that cannot be removed belongs to
+    // another user, and is never written to.
+    _ = std.c.shm_unlink(shm_name);
+    const shm_fd = std.c.shm_open(
+        shm_name,
+        common.RDWR | common.CREAT | common.EXECL,
+        std.c.S.IRUSR | std.c.S.IWUSR,
+    );
+    if (shm_fd == -1) {
+        log_to_file("daemon: shm_open {s} failed: code({any})\n", .{ shm_name, posix.errno(-1) });
+        return Error.shm_failed;
+    }
+    defer {
+        _ = std.c.close(shm_fd);
+        _ = std.c.shm_unlink(shm_name);
+    }
+    if (std.c.ftruncate(shm_fd, @sizeOf(common.StatusBlock)) != 0) {
+        log_to_file("daemon: ftruncate failed: code({any})\n", .{posix.errno(-1)});
+        return Error.shm_failed;
+    }
+    const mem_op = std.c.mmap(
+        null,
+        @sizeOf(common.StatusBlock),
+        std.c.PROT.READ | std.c.PROT.WRITE,
+        .{ .TYPE = .SHARED },
+        shm_fd,
+        0,
+    );
+    if (mem_op == std.c.MAP_FAILED) {
+        log_to_file("daemon: mmap failed: code({any})\n", .{posix.errno(-1)});
+        return Error.shm_failed;
+    }
+    const block: *common.StatusBlock = @ptrCast(@alignCast(mem_op));
+    block.init();
+    status_block = block;
+    // detach from the client that started us. It waits for this exit, by
+    // then the socket listens and the status memory exists.
+    if (try posix.fork() != 0) {
+        std.process.exit(0);
+    }
+    _ = std.c.setsid();
+
+    end_fd = try posix.eventfd(0, std.os.linux.EFD.NONBLOCK | std.os.linux.EFD.CLOEXEC);
+    defer posix.close(end_fd.?);
+    if (player.setup(playback_cb) == 0) {
+        log_to_file("daemon: failed to setup player.\n", .{});
+        return;
+    }
+    defer player.deinit();
+    var applied: Applied = .{
+        .in_progress = false,
+        .is_playing = false,
+        .volume = 1.0,
+        .tick_ms = 0,
+    };
+    var batch: [common.ring_size]common.CommandSlot = undefined;
+    var fds: [max_clients + 2]posix.pollfd = undefined;
+    var had_clients = false;
+    while (true) {
+        fds[0] = .{ .fd = listener, .events = posix.POLL.IN, .revents = 0 };
+        fds[1] = .{ .fd = end_fd.?, .events = posix.POLL.IN, .revents = 0 };
+        const polled = client_count;
+        for (clients[0..polled], 0..) |client, i| {
+            fds[2 + i] = .{ .fd = client, .events = posix.POLL.IN, .revents = 0 };
+        }
+        // wake up for ticks only while playing.
+        const ticking = applied.in_progress and applied.is_playing and applied.tick_ms > 0;
+        const timeout: i32 = if (ticking) @intCast(applied.tick_ms) else -1;
+        const ready = posix.poll(fds[0 .. 2 + polled], timeout) catch |err| {
+            log_to_file("daemon: poll failed: {any}\n", .{err});
+            return Error.wait_failed;
+        };
+        if (ready == 0) {
+            emit(.tick);
+            continue;
+        }
+        if (fds[1].revents & posix.POLL.IN != 0) {
+            var ended: u64 = 0;
+            _ = posix.read(end_fd.?, std.mem.asBytes(&ended)) catch {};
+            if (applied.in_progress and player.has_stopped() == 1) {
+                applied.in_progress = false;
+                applied.is_playing = false;
+                publish_status(block, &applied);
+                emit(.ended);
+                _ = player.sync.stop();
             }
-            if (m.volume != local_mem.volume) {
-                local_mem.volume = m.volume;
-                player.set_volume(local_mem.volume);
+        }
+        // commands of every client form one batch. Walk backwards so a
+        // removed client is replaced by one that was already read.
+        var count: usize = 0;
+        var i: usize = polled;
+        while (i > 0) {
+            i -= 1;
+            if (fds[2 + i].revents == 0) {
+                continue;
             }
-            if (m.should_stop) {
-                _ = player.stop();
-                break;
+            if (!read_client(clients[i], &batch, &count)) {
+                remove_client(i);
             }
         }
+        if (count > 0) {
+            _ = run_batch(&applied, batch[0..count]);
+            publish_status(block, &applied);
+        }
+        if (fds[0].revents & posix.POLL.IN != 0) {
+            accept_client(listener);
+            had_clients = true;
+        }
+        if (had_clients and client_count == 0) {
+            _ = player.sync.stop();
+            break;
+        }
     }
 }
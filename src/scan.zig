@@ -0,0 +1,684 @@
+//! Parallel library scanner.
+//! Walks a directory tree on a thread pool with getdents64, keeps the audio
+//! files and records them in the library index, signalling an eventfd the
+//! plugin polls from neovim's event loop.
+//! Directories whose mtime did not change since the last scan are taken
+//! from the index without being read.
+//! Only one scan runs at a time, starting a new one cancels the old one.
+const std = @import("std");
+const linux = std.os.linux;
+const posix = std.posix;
+const index = @import("index.zig");
+const tags = @import("tags.zig");
+
+const alloc = std.heap.smp_allocator;
+
+/// Size of the getdents64 buffer of every directory read.
+const dents_size: comptime_int = 64 * 1024;
+/// Bytes of paths collected before the plugin is woken up.
+const batch_bytes: comptime_int = 16 * 1024;
+/// Directory depth the scan stops at, a backstop to the visited set.
+const max_depth: comptime_int = 64;
+
+/// statx requests and flags.
+const STATX_TYPE: u32 = 0x0001;
+const STATX_MTIME: u32 = 0x0040;
+const STATX_INO: u32 = 0x0100;
+const STATX_SIZE: u32 = 0x0200;
+const AT_STATX_DONT_SYNC: u32 = 0x4000;
+const AT_EMPTY_PATH: u32 = 0x1000;
+/// File type bits of a mode.
+const S_IFMT: u32 = 0o170000;
+const S_IFDIR: u32 = 0o040000;
+const S_IFREG: u32 = 0o100000;
+
+/// File extensions of the supported audio formats.
+const extensions = [_][]const u8{ ".mp3", ".wav", ".flac" };
+
+/// Type of a directory entry.
+pub const EntryKind = enum {
+    directory,
+    file,
+    other,
+};
+
+/// Identity of a file, the same for every path that reaches it.
+pub const FileId = struct {
+    dev: u64,
+    ino: u64,
+};
+
+/// What statx tells about an entry.
+pub const Stat = struct {
+    kind: EntryKind,
+    size: u64,
+    mtime_sec: i64,
+    mtime_nsec: i64,
+    id: FileId,
+};
+
+/// A scanned audio file.
+const File = struct {
+    path: []const u8,
+    name_offset: usize,
+    size: u64,
+    mtime_sec: i64,
+    mtime_nsec: i64,
+    info: tags.Info,
+
+    fn name(self: *const File) []const u8 {
+        return self.path[self.name_offset..];
+    }
+};
+
+/// A scanned directory, filled by its own task.
+const Dir = struct {
+    path: [:0]const u8,
+    mtime_sec: i64 = 0,
+    mtime_nsec: i64 = 0,
+    files: std.ArrayList(File) = .empty,
+    /// Added by the task of this directory only.
+    children: std.ArrayList(*Dir) = .empty,
+    /// Flag for the directory being reached through another path already,
+    /// e.g. a symlink loop. Left out of the index.
+    duplicate: bool = false,
+};
+
+/// State of one scan.
+const Scan = struct {
+    /// Flag for the scan being cancelled, checked by every task.
+    cancelled: bool = false,
+    /// Flag for every task having finished.
+    done: bool = false,
+    /// Flag for the tree differing from the old index.
+    changed: bool = false,
+    /// Flag for descending into sub directories.
+    recursive: bool,
+    /// Flag for handing paths to the plugin as they are found, only when
+    /// there is no old index the plugin could show instead.
+    stream: bool = false,
+    /// Guards pending.
+    lock: std.Thread.Mutex = .{},
+    /// Newline separated paths not taken by the plugin yet.
+    pending: std.ArrayList(u8) = .empty,
+    /// The worker threads.
+    pool: std.Thread.Pool = undefined,
+    /// Tracks the directory tasks still running.
+    wg: std.Thread.WaitGroup = .{},
+    /// Waits for the tasks to finish, then writes the index.
+    coordinator: ?std.Thread = null,
+    /// Owns the tree, freed with the scan.
+    arena: std.heap.ArenaAllocator,
+    /// The arena, for the worker threads.
+    arena_lock: std.heap.ThreadSafeAllocator = undefined,
+    /// The scanned directory.
+    root: Dir,
+    /// The index of the last scan.
+    old: ?index.Index = null,
+    /// The directories of the old index by path.
+    old_dirs: std.StringHashMapUnmanaged(u32) = .empty,
+    /// Guards visited.
+    visited_lock: std.Thread.Mutex = .{},
+    /// The directories scanned so far, by identity.
+    visited: std.AutoHashMapUnmanaged(FileId, void) = .empty,
+
+    fn allocator(self: *Scan) std.mem.Allocator {
+        return self.arena_lock.allocator();
+    }
+
+    /// Claim a directory for the calling task.
+    ///
+    /// @return True if no task scanned it yet, false for a repeat.
+    fn visit(self: *Scan, id: FileId) bool {
+        self.visited_lock.lock();
+        defer self.visited_lock.unlock();
+        const result = self.visited.getOrPut(self.allocator(), id) catch return false;
+        return !result.found_existing;
+    }
+
+    fn mark_changed(self: *Scan) void {
+        @atomicStore(bool, &self.changed, true, .monotonic);
+    }
+};
+
+/// The current scan, only touched from the plugin's thread.
+var current: ?*Scan = null;
+/// Eventfd signalled when paths are ready or the scan is done.
+var event_fd: ?posix.fd_t = null;
+/// Paths handed to the plugin by the last scan_take, null terminated.
+var taken: std.ArrayList(u8) = .empty;
+/// The index mapped for the plugin by library_open.
+var view: ?index.Index = null;
+
+/// Wake up the plugin.
+fn signal() void {
+    const fd = event_fd orelse return;
+    const one: u64 = 1;
+    _ = posix.write(fd, std.mem.asBytes(&one)) catch {};
+}
+
+/// Get the directory path the scan and the index use for a root.
+pub fn normalize_root(root: [*:0]const u8) []const u8 {
+    // children are joined with a '/', keep the root's off.
+    const path = std.mem.trimRight(u8, std.mem.span(root), "/");
+    if (path.len == 0) {
+        return "/";
+    }
+    return path;
+}
+
+/// Check the file name for an audio file extension, ignoring case.
+pub fn has_audio_extension(name: []const u8) bool {
+    for (extensions) |ext| {
+        if (name.len > ext.len and std.ascii.endsWithIgnoreCase(name, ext)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Check the first bytes of a file for a supported audio format.
+/// Only used for files without an extension, it costs an open and a read.
+pub fn has_audio_magic(dir_fd: posix.fd_t, name: [*:0]const u8) bool {
+    const fd = posix.openatZ(dir_fd, name, .{ .CLOEXEC = true }, 0) catch return false;
+    defer posix.close(fd);
+    var head: [12]u8 = undefined;
+    const len = posix.read(fd, &head) catch return false;
+    const bytes = head[0..len];
+    if (std.mem.startsWith(u8, bytes, "ID3") or std.mem.startsWith(u8, bytes, "fLaC")) {
+        return true;
+    }
+    if (bytes.len >= 12 and std.mem.eql(u8, bytes[0..4], "RIFF") and std.mem.eql(u8, bytes[8..12], "WAVE")) {
+        return true;
+    }
+    // mpeg audio frame sync.
+    return bytes.len >= 2 and bytes[0] == 0xFF and (bytes[1] & 0xE0) == 0xE0;
+}
+
+/// Get the type, size and modification time of an entry.
+/// Follows symlinks, like the file they point to.
+///
+/// @param dir_fd The directory of the entry, or the entry itself with an
+///  empty name.
+/// @param name The entry name.
+/// @return The stat, null on failure.
+pub fn stat_entry(dir_fd: posix.fd_t, name: [*:0]const u8) ?Stat {
+    var stx: linux.Statx = undefined;
+    const flags = AT_STATX_DONT_SYNC | @as(u32, if (name[0] == 0) AT_EMPTY_PATH else 0);
+    const rc = linux.statx(dir_fd, name, flags, STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx);
+    if (linux.E.init(rc) != .SUCCESS) {
+        return null;
+    }
+    return .{
+        .kind = switch (@as(u32, stx.mode) & S_IFMT) {
+            S_IFDIR => .directory,
+            S_IFREG => .file,
+            else => .other,
+        },
+        .size = stx.size,
+        .mtime_sec = stx.mtime.sec,
+        .mtime_nsec = stx.mtime.nsec,
+        .id = .{
+            .dev = (@as(u64, stx.dev_major) << 32) | stx.dev_minor,
+            .ino = stx.ino,
+        },
+    };
+}
+
+/// Move the paths found in a directory to the pending batch.
+fn publish(scan: *Scan, found: *std.ArrayList(u8)) void {
+    if (found.items.len == 0) {
+        return;
+    }
+    scan.lock.lock();
+    const before = scan.pending.items.len;
+    scan.pending.appendSlice(alloc, found.items) catch {};
+    const after = scan.pending.items.len;
+    scan.lock.unlock();
+    found.clearRetainingCapacity();
+    // wake the plugin once per filled batch, it takes everything pending.
+    if (before / batch_bytes != after / batch_bytes or before == 0) {
+        signal();
+    }
+}
+
+/// Add a sub directory to a directory and scan it in its own task.
+fn add_child(scan: *Scan, dir: *Dir, path: [:0]const u8, depth: usize) void {
+    const a = scan.allocator();
+    const child = a.create(Dir) catch return;
+    child.* = .{ .path = path };
+    dir.children.append(a, child) catch return;
+    scan.pool.spawnWg(&scan.wg, scan_dir, .{ scan, child, depth + 1 });
+}
+
+/// Get the tags of a file of the old index.
+fn old_info(idx: *const index.Index, record: *const index.FileRecord) tags.Info {
+    return .{
+        .format = std.meta.intToEnum(tags.Format, record.format) catch .unknown,
+        .duration_ms = record.duration_ms,
+        .title = idx.str(record.title),
+        .artist = idx.str(record.artist),
+        .album = idx.str(record.album),
+    };
+}
+
+/// Fill a directory from the old index, its mtime did not change.
+fn reuse_dir(scan: *Scan, dir: *Dir, old: *const index.DirRecord, depth: usize) void {
+    const a = scan.allocator();
+    const idx = &scan.old.?;
+    for (idx.files_of(old)) |*record| {
+        const path = idx.str(record.path);
+        dir.files.append(a, .{
+            .path = path,
+            .name_offset = @min(record.name_offset, path.len),
+            .size = record.size,
+            .mtime_sec = record.mtime_sec,
+            .mtime_nsec = record.mtime_nsec,
+            .info = old_info(idx, record),
+        }) catch return;
+    }
+    if (depth + 1 >= max_depth) {
+        return;
+    }
+    // the sub directories are checked by their own tasks.
+    for (idx.children_of(old)) |*record| {
+        const path = a.dupeZ(u8, idx.str(record.path)) catch continue;
+        add_child(scan, dir, path, depth);
+    }
+}
+
+/// Read a directory whose mtime changed, or that is new.
+/// Files whose size and mtime match the old index keep their tags.
+fn read_dir(scan: *Scan, dir: *Dir, fd: posix.fd_t, old: ?*const index.DirRecord, depth: usize) void {
+    const a = scan.allocator();
+    var found: std.ArrayList(u8) = .empty;
+    defer found.deinit(alloc);
+    const buf = alloc.alignedAlloc(u8, .of(linux.dirent64), dents_size) catch return;
+    defer alloc.free(buf);
+    const sep = if (dir.path[dir.path.len - 1] == '/') "" else "/";
+    while (!@atomicLoad(bool, &scan.cancelled, .monotonic)) {
+        const rc = linux.getdents64(fd, buf.ptr, buf.len);
+        if (linux.E.init(rc) != .SUCCESS or rc == 0) {
+            break;
+        }
+        var offset: usize = 0;
+        while (offset < rc) {
+            const entry: *const linux.dirent64 = @ptrCast(@alignCast(&buf[offset]));
+            offset += entry.reclen;
+            const name_z: [*:0]const u8 = @ptrCast(&entry.name);
+            const name = std.mem.span(name_z);
+            if (std.mem.eql(u8, name, ".") or std.mem.eql(u8, name, "..")) {
+                continue;
+            }
+            const kind: EntryKind = switch (entry.type) {
+                linux.DT.DIR => .directory,
+                linux.DT.REG => .file,
+                // the listing does not know, e.g. symlinks or network mounts.
+                linux.DT.LNK, linux.DT.UNKNOWN => if (stat_entry(fd, name_z)) |stat| stat.kind else .other,
+                else => .other,
+            };
+            switch (kind) {
+                .directory => {
+                    if (!scan.recursive or depth + 1 >= max_depth) {
+                        continue;
+                    }
+                    const path = std.fmt.allocPrintSentinel(a, "{s}{s}{s}", .{ dir.path, sep, name }, 0) catch continue;
+                    add_child(scan, dir, path, depth);
+                },
+                .file => {
+                    const audio = has_audio_extension(name) or
+                        (std.mem.indexOfScalar(u8, name, '.') == null and has_audio_magic(fd, name_z));
+                    if (!audio) {
+                        continue;
+                    }
+                    const stat = stat_entry(fd, name_z) orelse continue;
+                    const path = std.fmt.allocPrintSentinel(a, "{s}{s}{s}", .{ dir.path, sep, name }, 0) catch continue;
+                    var file: File = .{
+                        .path = path,
+                        .name_offset = path.len - name.len,
+                        .size = stat.size,
+                        .mtime_sec = stat.mtime_sec,
+                        .mtime_nsec = stat.mtime_nsec,
+                        .info = .{},
+                    };
+                    const record = if (old) |o| scan.old.?.find_file(o, name) else null;
+                    if (record != null and record.?.size == stat.size and
+                        record.?.mtime_sec == stat.mtime_sec and record.?.mtime_nsec == stat.mtime_nsec)
+                    {
+                        file.info = old_info(&scan.old.?, record.?);
+                    } else {
+                        file.info = tags.read(a, fd, name_z, path, stat.size);
+                    }
+                    dir.files.append(a, file) catch continue;
+                    if (scan.stream) {
+                        found.print(alloc, "{s}\n", .{path}) catch continue;
+                        if (found.items.len >= batch_bytes) {
+                            publish(scan, &found);
+                        }
+                    }
+                },
+                .other => {},
+            }
+        }
+    }
+    publish(scan, &found);
+}
+
+/// Scan one directory, spawning a task for every sub directory.
+///
+/// @param scan The scan.
+/// @param dir The directory, owned by the task until the scan is done.
+/// @param depth The depth below the scan root.
+fn scan_dir(scan: *Scan, dir: *Dir, depth: usize) void {
+    if (@atomicLoad(bool, &scan.cancelled, .monotonic)) {
+        return;
+    }
+    const old: ?*const index.DirRecord = if (scan.old_dirs.get(dir.path)) |i| &scan.old.?.dirs[i] else null;
+    const fd = posix.openZ(dir.path, .{ .DIRECTORY = true, .CLOEXEC = true }, 0) catch {
+        if (old != null) {
+            scan.mark_changed();
+        }
+        return;
+    };
+    defer posix.close(fd);
+    const stat = stat_entry(fd, "") orelse {
+        scan.mark_changed();
+        return;
+    };
+    // symlinks may lead back up the tree, scan every directory once.
+    if (!scan.visit(stat.id)) {
+        dir.duplicate = true;
+        if (old != null) {
+            scan.mark_changed();
+        }
+        return;
+    }
+    dir.mtime_sec = stat.mtime_sec;
+    dir.mtime_nsec = stat.mtime_nsec;
+    if (old) |o| {
+        if (o.mtime_sec == stat.mtime_sec and o.mtime_nsec == stat.mtime_nsec) {
+            reuse_dir(scan, dir, o, depth);
+            return;
+        }
+    }
+    scan.mark_changed();
+    read_dir(scan, dir, fd, old, depth);
+}
+
+fn file_less(_: void, a: File, b: File) bool {
+    return std.mem.lessThan(u8, a.name(), b.name());
+}
+
+fn dir_less(_: void, a: *Dir, b: *Dir) bool {
+    return std.mem.lessThan(u8, a.path, b.path);
+}
+
+/// Write the scanned tree as the new index.
+fn write_index(scan: *Scan) void {
+    var writer = index.Writer.init(alloc);
+    defer writer.deinit();
+    // breadth first, so the children of every directory are contiguous.
+    var queue: std.ArrayList(*Dir) = .empty;
+    defer queue.deinit(alloc);
+    queue.append(alloc, &scan.root) catch return;
+    var i: usize = 0;
+    while (i < queue.items.len) : (i += 1) {
+        const dir = queue.items[i];
+        var kept: usize = 0;
+        for (dir.children.items) |child| {
+            if (!child.duplicate) {
+                dir.children.items[kept] = child;
+                kept += 1;
+            }
+        }
+        dir.children.shrinkRetainingCapacity(kept);
+        std.mem.sort(File, dir.files.items, {}, file_less);
+        std.mem.sort(*Dir, dir.children.items, {}, dir_less);
+        writer.dirs.append(alloc, .{
+            .mtime_sec = dir.mtime_sec,
+            .mtime_nsec = dir.mtime_nsec,
+            .path = writer.add_str(dir.path) catch return,
+            .first_child = @intCast(queue.items.len),
+            .child_count = @intCast(dir.children.items.len),
+            .first_file = @intCast(writer.files.items.len),
+            .file_count = @intCast(dir.files.items.len),
+        }) catch return;
+        for (dir.files.items) |file| {
+            writer.add_file(file.path, file.name_offset, file.size, file.mtime_sec, file.mtime_nsec, file.info) catch return;
+        }
+        queue.appendSlice(alloc, dir.children.items) catch return;
+    }
+    var path_buf: [index.path_max]u8 = undefined;
+    const path = index.index_path(&path_buf, scan.root.path, scan.recursive, true) orelse return;
+    writer.write(path, scan.root.path, scan.recursive) catch return;
+}
+
+/// Load the old index, scan the tree and write the new index.
+fn coordinate(scan: *Scan) void {
+    var path_buf: [index.path_max]u8 = undefined;
+    if (index.index_path(&path_buf, scan.root.path, scan.recursive, false)) |path| {
+        scan.old = index.Index.open(path, scan.root.path, scan.recursive);
+    }
+    if (scan.old) |*old| {
+        const a = scan.allocator();
+        scan.old_dirs.ensureTotalCapacity(a, @intCast(old.dirs.len)) catch {};
+        for (old.dirs, 0..) |*record, i| {
+            scan.old_dirs.put(a, old.str(record.path), @intCast(i)) catch break;
+        }
+    } else {
+        scan.stream = true;
+        scan.changed = true;
+    }
+    scan.pool.spawnWg(&scan.wg, scan_dir, .{ scan, &scan.root, 0 });
+    scan.pool.waitAndWork(&scan.wg);
+    if (!@atomicLoad(bool, &scan.cancelled, .monotonic) and @atomicLoad(bool, &scan.changed, .monotonic)) {
+        write_index(scan);
+    }
+    @atomicStore(bool, &scan.done, true, .release);
+    signal();
+}
+
+/// Cancel the current scan and wait for its tasks to stop.
+fn stop_scan() void {
+    const scan = current orelse return;
+    @atomicStore(bool, &scan.cancelled, true, .monotonic);
+    if (scan.coordinator) |thread| {
+        thread.join();
+    }
+    scan.pool.deinit();
+    scan.pending.deinit(alloc);
+    if (scan.old) |*old| {
+        old.close();
+    }
+    scan.arena.deinit();
+    alloc.destroy(scan);
+    current = null;
+}
+
+/// Start scanning a directory for audio files.
+/// Cancels the scan that is still running, if any. The library index of
+/// the directory is updated once the scan is done.
+///
+/// @param root The directory to scan.
+/// @param recursive 1 to descend into sub directories.
+/// @return 0 for success, Less than 0 for failure.
+pub export fn scan_start(root: [*:0]const u8, recursive: c_int) c_int {
+    stop_scan();
+    if (event_fd == null) {
+        event_fd = posix.eventfd(0, linux.EFD.NONBLOCK | linux.EFD.CLOEXEC) catch return -1;
+    }
+    const scan = alloc.create(Scan) catch return -2;
+    scan.* = .{
+        .recursive = recursive != 0,
+        .arena = .init(alloc),
+        .root = undefined,
+    };
+    scan.arena_lock = .{ .child_allocator = scan.arena.allocator() };
+    const path = scan.allocator().dupeZ(u8, normalize_root(root)) catch {
+        scan.arena.deinit();
+        alloc.destroy(scan);
+        return -2;
+    };
+    scan.root = .{ .path = path };
+    // network mounts spend most of their time waiting, so use more threads
+    // than cores.
+    const cpus = std.Thread.getCpuCount() catch 4;
+    scan.pool.init(.{ .allocator = alloc, .n_jobs = @max(4, cpus * 2) }) catch {
+        scan.arena.deinit();
+        alloc.destroy(scan);
+        return -3;
+    };
+    current = scan;
+    scan.coordinator = std.Thread.spawn(.{}, coordinate, .{scan}) catch {
+        stop_scan();
+        return -4;
+    };
+    return 0;
+}
+
+/// Get the eventfd that becomes readable when the scan has paths ready or
+/// is done.
+///
+/// @return The file descriptor, -1 if no scan ever started.
+pub export fn scan_fd() c_int {
+    return event_fd orelse -1;
+}
+
+/// Take the paths found since the last call.
+/// Paths are only handed out while building the first index of a
+/// directory, afterwards the plugin reads the index instead.
+/// Clears the eventfd once everything was taken.
+///
+/// @return Newline separated paths, valid until the next call. Null if there
+///  are none.
+pub export fn scan_take() ?[*:0]const u8 {
+    const scan = current orelse return null;
+    scan.lock.lock();
+    defer scan.lock.unlock();
+    if (scan.pending.items.len == 0) {
+        if (event_fd) |fd| {
+            var count: u64 = 0;
+            _ = posix.read(fd, std.mem.asBytes(&count)) catch {};
+        }
+        return null;
+    }
+    // swap the buffers, the workers keep appending to the other one.
+    std.mem.swap(std.ArrayList(u8), &taken, &scan.pending);
+    scan.pending.clearRetainingCapacity();
+    taken.append(alloc, 0) catch return null;
+    return @ptrCast(taken.items.ptr);
+}
+
+/// Get the flag for the scan having finished.
+///
+/// @return 1 once every directory was read, 0 otherwise.
+pub export fn scan_done() c_int {
+    const scan = current orelse return 1;
+    return @intFromBool(@atomicLoad(bool, &scan.done, .acquire));
+}
+
+/// Get the flag for the finished scan having written a new index.
+///
+/// @return 1 if the library changed since the last scan, 0 otherwise.
+pub export fn scan_changed() c_int {
+    const scan = current orelse return 0;
+    if (!@atomicLoad(bool, &scan.done, .acquire)) {
+        return 0;
+    }
+    return @intFromBool(@atomicLoad(bool, &scan.changed, .monotonic));
+}
+
+/// Cancel the running scan.
+pub export fn scan_cancel() void {
+    stop_scan();
+}
+
+/// A file of the library index, pointing into the mapped index.
+pub const LibraryEntry = extern struct {
+    path: [*]const u8,
+    title: [*]const u8,
+    artist: [*]const u8,
+    album: [*]const u8,
+    path_len: u32,
+    /// Offset of the file name in the path.
+    name_offset: u32,
+    title_len: u32,
+    artist_len: u32,
+    album_len: u32,
+    /// Duration in milliseconds, 0 if unknown.
+    duration_ms: u32,
+    /// 1 for mp3, 2 for wav, 3 for flac, 0 if unknown.
+    format: u8,
+    reserved: [7]u8,
+};
+
+/// Map the library index of a directory.
+/// The index is written by the first finished scan of the directory.
+///
+/// @param root The scanned directory.
+/// @param recursive 1 if sub directories were scanned.
+/// @return The number of files, -1 if the directory has no index.
+pub export fn library_open(root: [*:0]const u8, recursive: c_int) c_int {
+    library_close();
+    const path = normalize_root(root);
+    var path_buf: [index.path_max]u8 = undefined;
+    const index_file = index.index_path(&path_buf, path, recursive != 0, false) orelse return -1;
+    view = index.Index.open(index_file, path, recursive != 0);
+    const idx = view orelse return -1;
+    return @intCast(@min(idx.files.len, std.math.maxInt(c_int)));
+}
+
+/// Get a file of the mapped library index.
+/// Files are sorted by directory, then by name.
+///
+/// @param i The file index.
+/// @param out The file, valid until library_close.
+/// @return 0 for success, -1 if out of range.
+pub export fn library_entry(i: c_int, out: *LibraryEntry) c_int {
+    const idx = if (view) |*v| v else return -1;
+    if (i < 0 or @as(usize, @intCast(i)) >= idx.files.len) {
+        return -1;
+    }
+    const record = &idx.files[@intCast(i)];
+    const path = idx.str(record.path);
+    const title = idx.str(record.title);
+    const artist = idx.str(record.artist);
+    const album = idx.str(record.album);
+    out.* = .{
+        .path = path.ptr,
+        .title = title.ptr,
+        .artist = artist.ptr,
+        .album = album.ptr,
+        .path_len = @intCast(path.len),
+        .name_offset = @intCast(@min(record.name_offset, path.len)),
+        .title_len = @intCast(title.len),
+        .artist_len = @intCast(artist.len),
+        .album_len = @intCast(album.len),
+        .duration_ms = record.duration_ms,
+        .format = record.format,
+        .reserved = .{0} ** 7,
+    };
+    return 0;
+}
+
+/// Unmap the library index.
+pub export fn library_close() void {
+    if (view) |*idx| {
+        idx.close();
+        view = null;
+    }
+}
+
+test "a root is normalized without its trailing slashes" {
+    try std.testing.expectEqualStrings("/music", normalize_root("/music/"));
+    try std.testing.expectEqualStrings("/music", normalize_root("/music//"));
+    try std.testing.expectEqualStrings("/", normalize_root("/"));
+}
+
+test "audio extensions are matched ignoring case" {
+    try std.testing.expect(has_audio_extension("a.mp3"));
+    try std.testing.expect(has_audio_extension("B.FLAC"));
+    try std.testing.expect(has_audio_extension("c.Wav"));
+    try std.testing.expect(!has_audio_extension(".mp3"));
+    try std.testing.expect(!has_audio_extension("cover.jpg"));
+}
@@ -0,0 +1,136 @@
+//! Start child processes with posix_spawn.
+//! glibc implements it with clone(CLONE_VM | CLONE_VFORK), so the child
+//! never copies the page tables of a large parent the way fork does.
+const std = @import("std");
+const c = @cImport({
+    // posix_spawn_file_actions_addclosefrom_np.
+    @cDefine("_GNU_SOURCE", {});
+    @cInclude("spawn.h");
+    @cInclude("signal.h");
+    @cInclude("fcntl.h");
+});
+
+/// Error values.
+pub const Error = error{
+    /// Setting up the spawn attributes or file actions failed.
+    spawn_setup_failed,
+    /// posix_spawn failed.
+    spawn_failed,
+    /// Out of memory.
+    OutOfMemory,
+};
+
+/// The fd an inherited descriptor is moved to in the child.
+pub const inherit_fd: std.posix.fd_t = 3;
+
+/// Options of a spawn.
+pub const Options = struct {
+    /// A descriptor the child keeps, moved to inherit_fd.
+    /// Every other descriptor above stderr is closed in the child.
+    inherit: ?std.posix.fd_t = null,
+    /// Send stdout and stderr of the child to /dev/null.
+    quiet: bool = false,
+};
+
+/// Spawn a child process.
+/// stdin is /dev/null, signal dispositions and the signal mask are reset
+/// to the defaults so the child does not inherit the editor's.
+///
+/// @param allocator Allocator for the argument strings.
+/// @param argv The arguments, argv[0] is the executable path.
+/// @param options The spawn options.
+/// @return The PID of the child.
+pub fn spawn(allocator: std.mem.Allocator, argv: []const []const u8, options: Options) Error!std.posix.pid_t {
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const arena_alloc = arena.allocator();
+    const argv_z = try arena_alloc.allocSentinel(?[*:0]const u8, argv.len, null);
+    for (argv, 0..) |arg, i| {
+        argv_z[i] = try arena_alloc.dupeZ(u8, arg);
+    }
+
+    var actions: c.posix_spawn_file_actions_t = undefined;
+    if (c.posix_spawn_file_actions_init(&actions) != 0) {
+        return Error.spawn_setup_failed;
+    }
+    defer _ = c.posix_spawn_file_actions_destroy(&actions);
+    var attr: c.posix_spawnattr_t = undefined;
+    if (c.posix_spawnattr_init(&attr) != 0) {
+        return Error.spawn_setup_failed;
+    }
+    defer _ = c.posix_spawnattr_destroy(&attr);
+
+    var ok = c.posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", c.O_RDONLY, 0) == 0;
+    if (options.quiet) {
+        ok = ok and c.posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", c.O_WRONLY, 0) == 0;
+        ok = ok and c.posix_spawn_file_actions_adddup2(&actions, 1, 2) == 0;
+    }
+    var first_closed: c_int = inherit_fd;
+    if (options.inherit) |fd| {
+        // dup2 clears CLOEXEC on the copy, unless it is a no-op.
+        if (fd != inherit_fd) {
+            ok = ok and c.posix_spawn_file_actions_adddup2(&actions, fd, inherit_fd) == 0;
+        }
+        first_closed = inherit_fd + 1;
+    }
+    // nothing of the editor's leaks into the child, whether it was opened
+    // with CLOEXEC or not.
+    ok = ok and c.posix_spawn_file_actions_addclosefrom_np(&actions, first_closed) == 0;
+
+    var default_signals: c.sigset_t = undefined;
+    var no_signals: c.sigset_t = undefined;
+    ok = ok and c.sigfillset(&default_signals) == 0 and c.sigemptyset(&no_signals) == 0;
+    ok = ok and c.posix_spawnattr_setsigdefault(&attr, &default_signals) == 0;
+    ok = ok and c.posix_spawnattr_setsigmask(&attr, &no_signals) == 0;
+    ok = ok and c.posix_spawnattr_setflags(&attr, c.POSIX_SPAWN_SETSIGDEF | c.POSIX_SPAWN_SETSIGMASK) == 0;
+    if (!ok) {
+        return Error.spawn_setup_failed;
+    }
+
+    var pid: c.pid_t = 0;
+    const result = c.posix_spawn(
+        &pid,
+        argv_z[0].?,
+        &actions,
+        &attr,
+        @ptrCast(argv_z.ptr),
+        @ptrCast(std.c.environ),
+    );
+    if (result != 0) {
+        return Error.spawn_failed;
+    }
+    return pid;
+}
+
+/// Check for a child having exited, without reaping it.
+/// Until it is reaped its PID can not be reused, so it stays safe to signal.
+///
+/// @param pid The PID of the child.
+/// @param block Flag to wait for the exit.
+/// @return True if the child exited, or is no child of ours.
+pub fn exited(pid: std.posix.pid_t, block: bool) bool {
+    const linux = std.os.linux;
+    const flags: u32 = linux.W.EXITED | linux.W.NOWAIT | @as(u32, if (block) 0 else linux.W.NOHANG);
+    while (true) {
+        // a child still running leaves the info zeroed.
+        var info = std.mem.zeroes(linux.siginfo_t);
+        const rc = linux.waitid(.PID, pid, &info, flags);
+        switch (linux.E.init(rc)) {
+            .SUCCESS => return info.signo != 0,
+            .INTR => continue,
+            else => return true,
+        }
+    }
+}
+
+/// Wait for a child to exit.
+///
+/// @param pid The PID of the child.
+/// @return The exit code, null if it did not exit normally.
+pub fn wait(pid: std.posix.pid_t) ?u8 {
+    const result = std.posix.waitpid(pid, 0);
+    if (std.posix.W.IFEXITED(result.status)) {
+        return std.posix.W.EXITSTATUS(result.status);
+    }
+    return null;
+}
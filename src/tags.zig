@@ -0,0 +1,590 @@
+//! Duration and tags of audio files, read from their headers.
+//! Only reads the few KB of headers the formats put up front, never decodes
+//! audio, so it is cheap enough to run on every file of a library scan.
+const std = @import("std");
+const posix = std.posix;
+const c = @cImport({
+    @cInclude("seek_cache.h");
+});
+
+/// Longest tag value kept, in bytes.
+pub const tag_max: comptime_int = 255;
+/// Longest FLAC comment block read.
+const comment_block_max: comptime_int = 64 * 1024;
+/// Bytes searched for the first MPEG frame after the ID3 tag.
+const frame_search: comptime_int = 4096;
+
+/// Audio formats, stored in the library index.
+pub const Format = enum(u8) {
+    unknown = 0,
+    mp3 = 1,
+    wav = 2,
+    flac = 3,
+};
+
+/// What the headers of an audio file tell.
+/// The tag values are allocated with the allocator given to read.
+pub const Info = struct {
+    format: Format = .unknown,
+    /// Duration in milliseconds, 0 if unknown.
+    duration_ms: u32 = 0,
+    title: []const u8 = "",
+    artist: []const u8 = "",
+    album: []const u8 = "",
+};
+
+/// UTF-8 tag value under construction, truncated at tag_max.
+const TagBuf = struct {
+    buf: [tag_max]u8 = undefined,
+    len: usize = 0,
+
+    /// Append a code point.
+    /// @return false once the buffer is full.
+    fn push(self: *TagBuf, cp: u21) bool {
+        const n = std.unicode.utf8CodepointSequenceLength(cp) catch return true;
+        if (self.len + n > self.buf.len) {
+            return false;
+        }
+        _ = std.unicode.utf8Encode(cp, self.buf[self.len..]) catch return true;
+        self.len += n;
+        return true;
+    }
+
+    /// Append UTF-8 text up to the first NUL, skipping invalid sequences.
+    fn push_utf8(self: *TagBuf, text: []const u8) void {
+        var i: usize = 0;
+        while (i < text.len and text[i] != 0) {
+            const n = std.unicode.utf8ByteSequenceLength(text[i]) catch {
+                i += 1;
+                continue;
+            };
+            if (i + n > text.len) {
+                return;
+            }
+            const cp = std.unicode.utf8Decode(text[i .. i + n]) catch {
+                i += 1;
+                continue;
+            };
+            if (!self.push(cp)) {
+                return;
+            }
+            i += n;
+        }
+    }
+
+    /// Append Latin-1 text up to the first NUL.
+    fn push_latin1(self: *TagBuf, text: []const u8) void {
+        for (text) |byte| {
+            if (byte == 0 or !self.push(byte)) {
+                return;
+            }
+        }
+    }
+
+    /// Append UTF-16 text up to the first NUL, pairing surrogates.
+    fn push_utf16(self: *TagBuf, text: []const u8, endian: std.builtin.Endian) void {
+        var i: usize = 0;
+        while (i + 2 <= text.len) : (i += 2) {
+            const unit = std.mem.readInt(u16, text[i..][0..2], endian);
+            if (unit == 0) {
+                return;
+            }
+            var cp: u21 = unit;
+            if (unit >= 0xD800 and unit < 0xDC00 and i + 4 <= text.len) {
+                const low = std.mem.readInt(u16, text[i + 2 ..][0..2], endian);
+                if (low >= 0xDC00 and low < 0xE000) {
+                    cp = 0x10000 + ((@as(u21, unit) - 0xD800) << 10) + (low - 0xDC00);
+                    i += 2;
+                }
+            }
+            if (!self.push(cp)) {
+                return;
+            }
+        }
+    }
+
+    /// Copy the value out, without trailing spaces.
+    fn dupe(self: *const TagBuf, allocator: std.mem.Allocator) []const u8 {
+        const value = std.mem.trimRight(u8, self.buf[0..self.len], " ");
+        if (value.len == 0) {
+            return "";
+        }
+        return allocator.dupe(u8, value) catch "";
+    }
+};
+
+/// Read at an offset, a short read at the end of the file is fine.
+fn read_at(fd: posix.fd_t, buf: []u8, offset: u64) usize {
+    return posix.pread(fd, buf, offset) catch 0;
+}
+
+/// Decode a 28 bit syncsafe integer of an ID3v2 tag.
+fn syncsafe(bytes: *const [4]u8) u32 {
+    return (@as(u32, bytes[0] & 0x7F) << 21) | (@as(u32, bytes[1] & 0x7F) << 14) |
+        (@as(u32, bytes[2] & 0x7F) << 7) | (bytes[3] & 0x7F);
+}
+
+/// Decode the body of an ID3v2 text frame.
+fn id3_text(allocator: std.mem.Allocator, body: []const u8) []const u8 {
+    if (body.len < 2) {
+        return "";
+    }
+    var tag: TagBuf = .{};
+    const text = body[1..];
+    switch (body[0]) {
+        0 => tag.push_latin1(text),
+        1 => {
+            // UTF-16 with a byte order mark.
+            if (text.len >= 2 and text[0] == 0xFE and text[1] == 0xFF) {
+                tag.push_utf16(text[2..], .big);
+            } else if (text.len >= 2 and text[0] == 0xFF and text[1] == 0xFE) {
+                tag.push_utf16(text[2..], .little);
+            } else {
+                tag.push_utf16(text, .little);
+            }
+        },
+        2 => tag.push_utf16(text, .big),
+        3 => tag.push_utf8(text),
+        else => {},
+    }
+    return tag.dupe(allocator);
+}
+
+/// Read the title, artist and album of an ID3v2.3 or v2.4 tag.
+///
+/// @return The offset right after the tag, 0 if the file has none.
+fn read_id3(allocator: std.mem.Allocator, fd: posix.fd_t, info: *Info) u64 {
+    var head: [10]u8 = undefined;
+    if (read_at(fd, &head, 0) != head.len or !std.mem.eql(u8, head[0..3], "ID3")) {
+        return 0;
+    }
+    const major = head[3];
+    const flags = head[5];
+    const tag_end: u64 = 10 + @as(u64, syncsafe(head[6..10]));
+    // a footer repeats the header after the frames.
+    const end = if (flags & 0x10 != 0) tag_end + 10 else tag_end;
+    // v2.2 frames have other ids, unsynchronised tags need decoding first.
+    if ((major != 3 and major != 4) or flags & 0x80 != 0) {
+        return end;
+    }
+    var offset: u64 = 10;
+    if (flags & 0x40 != 0) {
+        var ext: [4]u8 = undefined;
+        if (read_at(fd, &ext, offset) != ext.len) {
+            return end;
+        }
+        // v2.3 does not count the size field itself.
+        offset += if (major == 4) syncsafe(&ext) else @as(u64, std.mem.readInt(u32, &ext, .big)) + 4;
+    }
+    // compression, encryption, grouping and v2.4 unsynchronisation.
+    const skip_flags: u8 = if (major == 4) 0x4F else 0xE0;
+    while (offset + 10 <= tag_end) {
+        var frame: [10]u8 = undefined;
+        // the padding after the last frame is zeros.
+        if (read_at(fd, &frame, offset) != frame.len or frame[0] == 0) {
+            break;
+        }
+        const frame_size: u64 = if (major == 4) syncsafe(frame[4..8]) else std.mem.readInt(u32, frame[4..8], .big);
+        const body_offset = offset + 10;
+        offset = body_offset + frame_size;
+        if (offset > tag_end) {
+            break;
+        }
+        const id = frame[0..4];
+        const field: *[]const u8 = if (std.mem.eql(u8, id, "TIT2"))
+            &info.title
+        else if (std.mem.eql(u8, id, "TPE1"))
+            &info.artist
+        else if (std.mem.eql(u8, id, "TALB"))
+            &info.album
+        else
+            continue;
+        // the first frame wins when an id repeats.
+        if (field.len > 0) {
+            continue;
+        }
+        if (frame[9] & skip_flags != 0) {
+            continue;
+        }
+        // UTF-16 takes up to twice the bytes of the kept value.
+        var body: [1 + 2 * (tag_max + 1)]u8 = undefined;
+        const len = read_at(fd, body[0..@min(body.len, frame_size)], body_offset);
+        field.* = id3_text(allocator, body[0..len]);
+    }
+    return end;
+}
+
+/// What an MPEG audio frame header tells.
+const MpegFrame = struct {
+    sample_rate: u32,
+    /// Bits per second.
+    bitrate: u32,
+    /// Samples per frame.
+    samples: u32,
+    /// Size of the layer III side info after the header.
+    side_info: u32,
+};
+
+/// Bitrates in kbps by version, layer and index.
+const bitrates = [5][15]u16{
+    // MPEG-1 layer I, II and III.
+    .{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+    .{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+    .{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+    // MPEG-2 and 2.5 layer I, then II and III.
+    .{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+    .{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+};
+
+/// Parse an MPEG audio frame header.
+///
+/// @return The frame info, null if the bytes are not a valid header.
+fn parse_frame(head: *const [4]u8) ?MpegFrame {
+    if (head[0] != 0xFF or head[1] & 0xE0 != 0xE0) {
+        return null;
+    }
+    // 0 is MPEG-2.5, 1 is reserved, 2 is MPEG-2, 3 is MPEG-1.
+    const version = (head[1] >> 3) & 0x3;
+    // 1 is layer III, 2 is layer II, 3 is layer I.
+    const layer_bits = (head[1] >> 1) & 0x3;
+    const bitrate_index = head[2] >> 4;
+    const rate_index = (head[2] >> 2) & 0x3;
+    if (version == 1 or layer_bits == 0 or bitrate_index == 0 or bitrate_index == 15 or rate_index == 3) {
+        return null;
+    }
+    const layer: u32 = 4 - @as(u32, layer_bits);
+    const mpeg1 = version == 3;
+    const mono = head[3] >> 6 == 3;
+    const base_rates = [3]u32{ 44100, 48000, 32000 };
+    const sample_rate = switch (version) {
+        3 => base_rates[rate_index],
+        2 => base_rates[rate_index] / 2,
+        else => base_rates[rate_index] / 4,
+    };
+    const table: usize = if (mpeg1) layer - 1 else if (layer == 1) 3 else 4;
+    return .{
+        .sample_rate = sample_rate,
+        .bitrate = @as(u32, bitrates[table][bitrate_index]) * 1000,
+        .samples = if (layer == 1) 384 else if (layer == 2 or mpeg1) 1152 else 576,
+        .side_info = if (mpeg1) (if (mono) 17 else 32) else (if (mono) 9 else 17),
+    };
+}
+
+/// Convert frames at a sample rate to milliseconds.
+fn frames_to_ms(frames: u64, sample_rate: u32) u32 {
+    if (sample_rate == 0) {
+        return 0;
+    }
+    return @intCast(@min(frames * 1000 / sample_rate, std.math.maxInt(u32)));
+}
+
+/// Get the duration of an MP3 file.
+/// Uses the frame count of a Xing, Info or VBRI header, then the seek
+/// cache of a previous play, then the size at the first frame's bitrate.
+///
+/// @param fd The file.
+/// @param start Offset of the audio after the ID3 tag.
+/// @param size Size of the file.
+/// @param path Path of the file, the seek cache key.
+/// @return true if the file has an MPEG frame.
+fn read_mp3(fd: posix.fd_t, start: u64, size: u64, path: [:0]const u8, info: *Info) bool {
+    var buf: [frame_search]u8 = undefined;
+    const len = read_at(fd, &buf, start);
+    var frame_offset: usize = 0;
+    const frame = while (frame_offset + 4 <= len) : (frame_offset += 1) {
+        if (parse_frame(buf[frame_offset..][0..4])) |found| {
+            break found;
+        }
+    } else return false;
+
+    const vbr_tags = [_]struct { usize, []const u8, usize }{
+        // tag offset, tag, frame count offset from the tag.
+        .{ 4 + frame.side_info, "Xing", 8 },
+        .{ 4 + frame.side_info, "Info", 8 },
+        .{ 4 + 32, "VBRI", 14 },
+    };
+    for (vbr_tags) |vbr| {
+        const at = frame_offset + vbr[0];
+        if (at + vbr[2] + 4 > len or !std.mem.eql(u8, buf[at .. at + 4], vbr[1])) {
+            continue;
+        }
+        // Xing and Info only carry the frame count when flag 1 is set.
+        if (vbr[2] == 8 and buf[at + 7] & 0x1 == 0) {
+            continue;
+        }
+        const frames = std.mem.readInt(u32, buf[at + vbr[2] ..][0..4], .big);
+        info.duration_ms = frames_to_ms(@as(u64, frames) * frame.samples, frame.sample_rate);
+        return true;
+    }
+
+    var total_frames: u64 = 0;
+    if (c.seek_cache_total_frames(path.ptr, &total_frames)) {
+        info.duration_ms = frames_to_ms(total_frames, frame.sample_rate);
+        return true;
+    }
+
+    const audio_start = start + frame_offset;
+    if (size > audio_start) {
+        info.duration_ms = @intCast(@min((size - audio_start) * 8 * 1000 / frame.bitrate, std.math.maxInt(u32)));
+    }
+    return true;
+}
+
+/// Read the title, artist and album of a RIFF LIST INFO chunk.
+fn read_riff_info(allocator: std.mem.Allocator, fd: posix.fd_t, body: u64, size: u64, info: *Info) void {
+    var kind: [4]u8 = undefined;
+    if (read_at(fd, &kind, body) != kind.len or !std.mem.eql(u8, &kind, "INFO")) {
+        return;
+    }
+    const end = body + size;
+    var offset = body + 4;
+    while (offset + 8 <= end) {
+        var head: [8]u8 = undefined;
+        if (read_at(fd, &head, offset) != head.len) {
+            return;
+        }
+        const sub_size: u64 = std.mem.readInt(u32, head[4..8], .little);
+        const sub_body = offset + 8;
+        offset = sub_body + sub_size + (sub_size & 1);
+        const id = head[0..4];
+        const field: *[]const u8 = if (std.mem.eql(u8, id, "INAM"))
+            &info.title
+        else if (std.mem.eql(u8, id, "IART"))
+            &info.artist
+        else if (std.mem.eql(u8, id, "IPRD"))
+            &info.album
+        else
+            continue;
+        var text: [tag_max]u8 = undefined;
+        const len = read_at(fd, text[0..@min(text.len, sub_size)], sub_body);
+        var tag: TagBuf = .{};
+        tag.push_utf8(text[0..len]);
+        field.* = tag.dupe(allocator);
+    }
+}
+
+/// Read the duration and tags of a WAV file.
+fn read_wav(allocator: std.mem.Allocator, fd: posix.fd_t, size: u64, info: *Info) void {
+    var byte_rate: u32 = 0;
+    var data_size: u64 = 0;
+    var offset: u64 = 12;
+    while (offset + 8 <= size) {
+        var head: [8]u8 = undefined;
+        if (read_at(fd, &head, offset) != head.len) {
+            break;
+        }
+        const chunk_size: u64 = std.mem.readInt(u32, head[4..8], .little);
+        const body = offset + 8;
+        const id = head[0..4];
+        if (std.mem.eql(u8, id, "fmt ")) {
+            var fmt: [12]u8 = undefined;
+            if (read_at(fd, &fmt, body) == fmt.len) {
+                byte_rate = std.mem.readInt(u32, fmt[8..12], .little);
+            }
+        } else if (std.mem.eql(u8, id, "data")) {
+            // streamed files leave the size at its maximum.
+            data_size = @min(chunk_size, size - body);
+        } else if (std.mem.eql(u8, id, "LIST")) {
+            read_riff_info(allocator, fd, body, chunk_size, info);
+        }
+        offset = body + chunk_size + (chunk_size & 1);
+    }
+    if (byte_rate > 0) {
+        info.duration_ms = @intCast(@min(data_size * 1000 / byte_rate, std.math.maxInt(u32)));
+    }
+}
+
+/// Read the title, artist and album of a FLAC Vorbis comment block.
+fn read_vorbis_comment(allocator: std.mem.Allocator, fd: posix.fd_t, body: u64, size: u64, info: *Info) void {
+    const block = std.heap.smp_allocator.alloc(u8, @min(size, comment_block_max)) catch return;
+    defer std.heap.smp_allocator.free(block);
+    const len = read_at(fd, block, body);
+    const bytes = block[0..len];
+    if (bytes.len < 4) {
+        return;
+    }
+    // the block is little endian, unlike the rest of FLAC.
+    var offset: usize = 4 + @as(usize, std.mem.readInt(u32, bytes[0..4], .little));
+    if (offset + 4 > bytes.len) {
+        return;
+    }
+    var count = std.mem.readInt(u32, bytes[offset..][0..4], .little);
+    offset += 4;
+    while (count > 0 and offset + 4 <= bytes.len) : (count -= 1) {
+        const comment_len = std.mem.readInt(u32, bytes[offset..][0..4], .little);
+        offset += 4;
+        if (comment_len > bytes.len - offset) {
+            return;
+        }
+        const comment = bytes[offset .. offset + comment_len];
+        offset += comment_len;
+        const eq = std.mem.indexOfScalar(u8, comment, '=') orelse continue;
+        const key = comment[0..eq];
+        const field: *[]const u8 = if (std.ascii.eqlIgnoreCase(key, "TITLE"))
+            &info.title
+        else if (std.ascii.eqlIgnoreCase(key, "ARTIST"))
+            &info.artist
+        else if (std.ascii.eqlIgnoreCase(key, "ALBUM"))
+            &info.album
+        else
+            continue;
+        // the first value wins when a key repeats.
+        if (field.len > 0) {
+            continue;
+        }
+        var tag: TagBuf = .{};
+        tag.push_utf8(comment[eq + 1 ..]);
+        field.* = tag.dupe(allocator);
+    }
+}
+
+/// Read the duration and tags of a FLAC file.
+///
+/// @param start Offset of the fLaC marker.
+fn read_flac(allocator: std.mem.Allocator, fd: posix.fd_t, start: u64, info: *Info) void {
+    var offset = start + 4;
+    while (true) {
+        var head: [4]u8 = undefined;
+        if (read_at(fd, &head, offset) != head.len) {
+            return;
+        }
+        const last = head[0] & 0x80 != 0;
+        const kind = head[0] & 0x7F;
+        const len: u64 = std.mem.readInt(u24, head[1..4], .big);
+        const body = offset + 4;
+        if (kind == 0) {
+            var stream_info: [18]u8 = undefined;
+            if (read_at(fd, &stream_info, body) == stream_info.len) {
+                const si = &stream_info;
+                const sample_rate = (@as(u32, si[10]) << 12) | (@as(u32, si[11]) << 4) | (si[12] >> 4);
+                const total = (@as(u64, si[13] & 0x0F) << 32) | std.mem.readInt(u32, si[14..18], .big);
+                info.duration_ms = frames_to_ms(total, sample_rate);
+            }
+        } else if (kind == 4) {
+            read_vorbis_comment(allocator, fd, body, len, info);
+        }
+        if (last) {
+            return;
+        }
+        offset = body + len;
+    }
+}
+
+/// Read the format, duration and tags of an audio file.
+///
+/// @param allocator Allocator for the tag values.
+/// @param dir_fd The directory of the file.
+/// @param name The file name in the directory.
+/// @param path The full path of the file.
+/// @param size The size of the file.
+/// @return What the headers tell, the format is unknown if they are not
+///  audio.
+pub fn read(allocator: std.mem.Allocator, dir_fd: posix.fd_t, name: [*:0]const u8, path: [:0]const u8, size: u64) Info {
+    const fd = posix.openatZ(dir_fd, name, .{ .CLOEXEC = true }, 0) catch return .{};
+    defer posix.close(fd);
+    var info: Info = .{};
+    // any format may be prefixed by an ID3 tag, though only MP3 should be.
+    const start = read_id3(allocator, fd, &info);
+    var magic: [12]u8 = undefined;
+    const len = read_at(fd, &magic, start);
+    if (len >= 4 and std.mem.eql(u8, magic[0..4], "fLaC")) {
+        info.format = .flac;
+        read_flac(allocator, fd, start, &info);
+    } else if (start == 0 and len == magic.len and std.mem.eql(u8, magic[0..4], "RIFF") and std.mem.eql(u8, magic[8..12], "WAVE")) {
+        info.format = .wav;
+        read_wav(allocator, fd, size, &info);
+    } else if (read_mp3(fd, start, size, path, &info)) {
+        info.format = .mp3;
+    }
+    return info;
+}
+
+/// Build an ID3v2.3 frame for the tests.
+fn test_frame(comptime id: []const u8, comptime body: []const u8) []const u8 {
+    comptime {
+        var size: [4]u8 = undefined;
+        std.mem.writeInt(u32, &size, body.len, .big);
+        return id ++ size ++ "\x00\x00" ++ body;
+    }
+}
+
+/// Build an ID3v2.3 tag of the given frames for the tests.
+fn test_tag(comptime frames: []const u8) []const u8 {
+    comptime {
+        const n = frames.len;
+        const size = [4]u8{ (n >> 21) & 0x7F, (n >> 14) & 0x7F, (n >> 7) & 0x7F, n & 0x7F };
+        return "ID3\x03\x00\x00" ++ size ++ frames;
+    }
+}
+
+/// Read a file of the given bytes, free the result with free_test_info.
+fn read_test_file(tmp: *std.testing.TmpDir, bytes: []const u8) !Info {
+    try tmp.dir.writeFile(.{ .sub_path = "test.mp3", .data = bytes });
+    // a path that does not exist never hits the seek cache.
+    return read(std.testing.allocator, tmp.dir.fd, "test.mp3", "/nonexistent/test.mp3", bytes.len);
+}
+
+fn free_test_info(info: Info) void {
+    for ([_][]const u8{ info.title, info.artist, info.album }) |value| {
+        if (value.len > 0) {
+            std.testing.allocator.free(value);
+        }
+    }
+}
+
+test "id3 text frames in latin-1 and utf-16 with a byte order mark" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const info = try read_test_file(&tmp, test_tag(
+        test_frame("TIT2", "\x00Title  ") ++
+            test_frame("TPE1", "\x01\xFF\xFEH\x00\xE9\x00\x00\x00") ++
+            test_frame("TALB", "\x01\xFE\xFF\x00A\x00l"),
+    ));
+    defer free_test_info(info);
+    try std.testing.expectEqualStrings("Title", info.title);
+    try std.testing.expectEqualStrings("H\u{E9}", info.artist);
+    try std.testing.expectEqualStrings("Al", info.album);
+}
+
+test "a repeated id3 frame keeps the first value" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    // the testing allocator fails the test if the second value leaks.
+    const info = try read_test_file(&tmp, test_tag(
+        test_frame("TIT2", "\x00One") ++ test_frame("TIT2", "\x00Two"),
+    ));
+    defer free_test_info(info);
+    try std.testing.expectEqualStrings("One", info.title);
+}
+
+test "id3 frames past the end of the tag are skipped" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const truncated = try read_test_file(&tmp, test_tag("TIT2\x00\x00\x00\x64\x00\x00\x00abc"));
+    defer free_test_info(truncated);
+    try std.testing.expectEqualStrings("", truncated.title);
+    const oversized = try read_test_file(&tmp, test_tag(
+        test_frame("TPE1", "\x00Artist") ++ "TIT2\xFF\xFF\xFF\xFF\x00\x00\x00abc",
+    ));
+    defer free_test_info(oversized);
+    try std.testing.expectEqualStrings("Artist", oversized.artist);
+    try std.testing.expectEqualStrings("", oversized.title);
+    // a tag claiming more bytes than the file has.
+    const short = try read_test_file(&tmp, "ID3\x03\x00\x00\x00\x00\x7F\x7F" ++ test_frame("TIT2", "\x00Title")[0..10]);
+    defer free_test_info(short);
+    try std.testing.expectEqualStrings("", short.title);
+    try std.testing.expectEqual(Format.unknown, short.format);
+}
+
+test "the frame count of a xing header gives the mp3 duration" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    // MPEG-1 layer III, 128 kbps, 44.1 kHz, joint stereo, so the Xing tag
+    // follows 32 bytes of side info.
+    const xing = "\xFF\xFB\x90\x44" ++ ("\x00" ** 32) ++ "Xing\x00\x00\x00\x01" ++ "\x00\x00\x03\xE8";
+    const info = try read_test_file(&tmp, xing ++ ("\x00" ** 400));
+    defer free_test_info(info);
+    try std.testing.expectEqual(Format.mp3, info.format);
+    // 1000 frames of 1152 samples.
+    try std.testing.expectEqual(@as(u32, 26122), info.duration_ms);
+}
@@ -0,0 +1,846 @@
+//! Live library watcher.
+//! Keeps the library index of a directory current with inotify, so new
+//! downloads show up without rescans. Every directory of the library gets a
+//! watch, added and removed as directories come and go. Changed files are
+//! handed to the plugin as row changes, and the index is rewritten once the
+//! changes settle.
+//! A queue overflow drops events, so the watcher then resyncs against the
+//! directory mtimes, the same way a scan does.
+const std = @import("std");
+const linux = std.os.linux;
+const posix = std.posix;
+const index = @import("index.zig");
+const scan = @import("scan.zig");
+const tags = @import("tags.zig");
+
+const alloc = std.heap.smp_allocator;
+
+/// Time the index is rewritten after the first unsaved change, in ms.
+const flush_delay_ms: comptime_int = 1000;
+/// Size of the inotify read buffer.
+const events_size: comptime_int = 16 * 1024;
+
+/// Events every directory is watched for.
+/// Files are only picked up once written and closed, or moved in, so
+/// downloads in progress are skipped.
+const watch_mask: u32 = linux.IN.CREATE | linux.IN.DELETE | linux.IN.MOVED_FROM |
+    linux.IN.MOVED_TO | linux.IN.CLOSE_WRITE | linux.IN.DELETE_SELF | linux.IN.MOVE_SELF |
+    linux.IN.ONLYDIR | linux.IN.EXCL_UNLINK;
+
+/// A file of the library.
+const FileState = struct {
+    size: u64,
+    mtime_sec: i64,
+    mtime_nsec: i64,
+    /// Tag values are owned.
+    info: tags.Info,
+    /// Mark of the last listing that saw the file.
+    mark: u32 = 0,
+};
+
+/// A directory of the library.
+const DirState = struct {
+    /// Owned, also the key in Watcher.dirs.
+    path: [:0]u8,
+    /// The inotify watch, -1 if not watched.
+    wd: i32 = -1,
+    mtime_sec: i64 = 0,
+    mtime_nsec: i64 = 0,
+    /// Audio files by name, the names are owned.
+    files: std.StringHashMapUnmanaged(FileState) = .empty,
+    /// Mark of the last listing that saw a sub directory, by owned name.
+    subdirs: std.StringHashMapUnmanaged(u32) = .empty,
+    /// Generation of the last resync that reached the directory.
+    generation: u32 = 0,
+    /// Identity of the directory, null until it was synced.
+    id: ?scan.FileId = null,
+};
+
+/// State of the watcher.
+/// Everything but pending is only touched by the watcher thread.
+const Watcher = struct {
+    /// The watched directory.
+    root: [:0]u8,
+    /// Flag for watching sub directories.
+    recursive: bool,
+    inotify_fd: posix.fd_t,
+    /// Eventfd telling the thread to stop.
+    stop_fd: posix.fd_t,
+    thread: ?std.Thread = null,
+    /// The index the library is loaded from, closed once loaded.
+    initial: ?index.Index,
+    /// The directories by path.
+    dirs: std.StringHashMapUnmanaged(*DirState) = .empty,
+    /// The directories by watch.
+    wds: std.AutoHashMapUnmanaged(i32, *DirState) = .empty,
+    /// The directories by identity, one per directory however many paths
+    /// reach it.
+    ids: std.AutoHashMapUnmanaged(scan.FileId, *DirState) = .empty,
+    /// Bumped on every resync.
+    generation: u32 = 0,
+    /// Bumped on every directory listing.
+    mark: u32 = 0,
+    /// Time of the first change not written to the index, in ms.
+    dirty_since: ?i64 = null,
+    /// Guards pending.
+    lock: std.Thread.Mutex = .{},
+    /// Row changes not taken by the plugin yet, one per line.
+    pending: std.ArrayList(u8) = .empty,
+};
+
+/// The running watcher, only touched from the plugin's thread.
+var current: ?*Watcher = null;
+/// Eventfd signalled when row changes are ready.
+var event_fd: ?posix.fd_t = null;
+/// Row changes handed to the plugin by the last watch_take, null terminated.
+var taken: std.ArrayList(u8) = .empty;
+
+/// Wake up the plugin.
+fn signal() void {
+    const fd = event_fd orelse return;
+    const one: u64 = 1;
+    _ = posix.write(fd, std.mem.asBytes(&one)) catch {};
+}
+
+fn dupe_str(s: []const u8) []const u8 {
+    if (s.len == 0) {
+        return "";
+    }
+    return alloc.dupe(u8, s) catch "";
+}
+
+fn free_str(s: []const u8) void {
+    if (s.len > 0) {
+        alloc.free(s);
+    }
+}
+
+fn free_info(info: tags.Info) void {
+    free_str(info.title);
+    free_str(info.artist);
+    free_str(info.album);
+}
+
+/// Join a directory and an entry name, the caller frees the path.
+fn join(dir: []const u8, name: []const u8) ?[:0]u8 {
+    const sep = if (dir[dir.len - 1] == '/') "" else "/";
+    return std.fmt.allocPrintSentinel(alloc, "{s}{s}{s}", .{ dir, sep, name }, 0) catch null;
+}
+
+/// Append a tag to a row change, without the separators.
+fn append_field(out: *std.ArrayList(u8), value: []const u8) void {
+    for (value) |byte| {
+        out.append(alloc, if (byte == '\t' or byte == '\n') ' ' else byte) catch return;
+    }
+}
+
+/// Queue a file being added or changed.
+/// The line is "+path\ttitle\tartist\talbum\tduration_ms".
+fn emit_add(w: *Watcher, path: []const u8, info: tags.Info) void {
+    w.lock.lock();
+    defer w.lock.unlock();
+    w.pending.print(alloc, "+{s}\t", .{path}) catch return;
+    append_field(&w.pending, info.title);
+    w.pending.append(alloc, '\t') catch return;
+    append_field(&w.pending, info.artist);
+    w.pending.append(alloc, '\t') catch return;
+    append_field(&w.pending, info.album);
+    w.pending.print(alloc, "\t{d}\n", .{info.duration_ms}) catch return;
+}
+
+/// Queue a file being removed.
+/// The line is "-path".
+fn emit_remove(w: *Watcher, path: []const u8) void {
+    w.lock.lock();
+    defer w.lock.unlock();
+    w.pending.print(alloc, "-{s}\n", .{path}) catch return;
+}
+
+/// Note a change the index does not have yet.
+fn mark_dirty(w: *Watcher) void {
+    if (w.dirty_since == null) {
+        w.dirty_since = std.time.milliTimestamp();
+    }
+}
+
+/// Add a directory to the library.
+fn add_dir(w: *Watcher, path: []const u8) ?*DirState {
+    const dir = alloc.create(DirState) catch return null;
+    const owned = alloc.dupeZ(u8, path) catch {
+        alloc.destroy(dir);
+        return null;
+    };
+    dir.* = .{ .path = owned };
+    w.dirs.put(alloc, owned, dir) catch {
+        alloc.free(owned);
+        alloc.destroy(dir);
+        return null;
+    };
+    return dir;
+}
+
+/// Watch a directory.
+/// Failures, like running out of watches, leave it unwatched until the
+/// next resync.
+fn watch_dir(w: *Watcher, dir: *DirState) void {
+    const rc = linux.inotify_add_watch(w.inotify_fd, dir.path, watch_mask);
+    if (linux.E.init(rc) != .SUCCESS) {
+        return;
+    }
+    // the same directory always gets the same watch.
+    const wd: i32 = @intCast(rc);
+    const result = w.wds.getOrPut(alloc, wd) catch return;
+    if (result.found_existing and result.value_ptr.* != dir) {
+        // another path of the directory holds the watch, keep it there.
+        return;
+    }
+    result.value_ptr.* = dir;
+    dir.wd = wd;
+}
+
+/// Remove a file from the library.
+fn remove_file(w: *Watcher, dir: *DirState, name: []const u8) void {
+    const kv = dir.files.fetchRemove(name) orelse return;
+    if (join(dir.path, name)) |path| {
+        emit_remove(w, path);
+        alloc.free(path);
+    }
+    alloc.free(kv.key);
+    free_info(kv.value.info);
+    mark_dirty(w);
+}
+
+/// Add or update a file of the library.
+/// The tags are only read again if the size or mtime changed.
+///
+/// @param dir The directory of the file.
+/// @param dir_fd The directory, or AT.FDCWD with a full path as entry.
+/// @param entry The file, relative to dir_fd.
+/// @param name The file name.
+/// @param mark The mark of the listing, 0 outside of one.
+fn update_file(w: *Watcher, dir: *DirState, dir_fd: posix.fd_t, entry: [*:0]const u8, name: []const u8, mark: u32) void {
+    const stat = scan.stat_entry(dir_fd, entry) orelse {
+        remove_file(w, dir, name);
+        return;
+    };
+    if (stat.kind != .file) {
+        return;
+    }
+    if (dir.files.getPtr(name)) |file| {
+        file.mark = mark;
+        if (file.size == stat.size and file.mtime_sec == stat.mtime_sec and file.mtime_nsec == stat.mtime_nsec) {
+            return;
+        }
+    }
+    const path = join(dir.path, name) orelse return;
+    defer alloc.free(path);
+    const info = tags.read(alloc, dir_fd, entry, path, stat.size);
+    const result = dir.files.getOrPut(alloc, name) catch {
+        free_info(info);
+        return;
+    };
+    if (result.found_existing) {
+        free_info(result.value_ptr.info);
+    } else {
+        result.key_ptr.* = alloc.dupe(u8, name) catch {
+            dir.files.removeByPtr(result.key_ptr);
+            free_info(info);
+            return;
+        };
+    }
+    result.value_ptr.* = .{
+        .size = stat.size,
+        .mtime_sec = stat.mtime_sec,
+        .mtime_nsec = stat.mtime_nsec,
+        .info = info,
+        .mark = mark,
+    };
+    emit_add(w, path, info);
+    mark_dirty(w);
+}
+
+/// Free a directory that is no longer in any map.
+fn free_dir(dir: *DirState) void {
+    var files = dir.files.iterator();
+    while (files.next()) |kv| {
+        alloc.free(kv.key_ptr.*);
+        free_info(kv.value_ptr.info);
+    }
+    dir.files.deinit(alloc);
+    var subdirs = dir.subdirs.keyIterator();
+    while (subdirs.next()) |name| {
+        alloc.free(name.*);
+    }
+    dir.subdirs.deinit(alloc);
+    alloc.free(dir.path);
+    alloc.destroy(dir);
+}
+
+/// Remove a directory and everything below it from the library.
+fn remove_dir(w: *Watcher, path: []const u8) void {
+    var doomed: std.ArrayList(*DirState) = .empty;
+    defer doomed.deinit(alloc);
+    var it = w.dirs.valueIterator();
+    while (it.next()) |dir| {
+        const p = dir.*.path;
+        const below = p.len > path.len and std.mem.startsWith(u8, p, path) and
+            (path[path.len - 1] == '/' or p[path.len] == '/');
+        if (below or std.mem.eql(u8, p, path)) {
+            doomed.append(alloc, dir.*) catch return;
+        }
+    }
+    for (doomed.items) |dir| {
+        _ = w.dirs.remove(dir.path);
+        if (dir.id) |id| {
+            if (w.ids.get(id) == dir) {
+                _ = w.ids.remove(id);
+            }
+        }
+        if (dir.wd >= 0) {
+            // moved away directories keep their watch, deleted ones already
+            // lost it.
+            _ = linux.inotify_rm_watch(w.inotify_fd, dir.wd);
+            _ = w.wds.remove(dir.wd);
+        }
+        var files = dir.files.keyIterator();
+        while (files.next()) |name| {
+            if (join(dir.path, name.*)) |file_path| {
+                emit_remove(w, file_path);
+                alloc.free(file_path);
+            }
+        }
+        free_dir(dir);
+        mark_dirty(w);
+    }
+}
+
+/// Read a directory listing and apply the differences to the library.
+///
+/// @param dir The directory.
+/// @param fd The open directory.
+/// @param stack The sub directories to visit next are appended to it.
+fn read_listing(w: *Watcher, dir: *DirState, fd: posix.fd_t, stack: *std.ArrayList([:0]u8)) void {
+    w.mark +%= 1;
+    if (w.mark == 0) {
+        w.mark = 1;
+    }
+    const mark = w.mark;
+    var buf: [8192]u8 align(@alignOf(linux.dirent64)) = undefined;
+    while (true) {
+        const rc = linux.getdents64(fd, &buf, buf.len);
+        if (linux.E.init(rc) != .SUCCESS) {
+            // a partial listing would drop files that are there.
+            return;
+        }
+        if (rc == 0) {
+            break;
+        }
+        var offset: usize = 0;
+        while (offset < rc) {
+            const entry: *const linux.dirent64 = @ptrCast(@alignCast(&buf[offset]));
+            offset += entry.reclen;
+            const name_z: [*:0]const u8 = @ptrCast(&entry.name);
+            const name = std.mem.span(name_z);
+            if (std.mem.eql(u8, name, ".") or std.mem.eql(u8, name, "..")) {
+                continue;
+            }
+            const kind: scan.EntryKind = switch (entry.type) {
+                linux.DT.DIR => .directory,
+                linux.DT.REG => .file,
+                linux.DT.LNK, linux.DT.UNKNOWN => if (scan.stat_entry(fd, name_z)) |stat| stat.kind else .other,
+                else => .other,
+            };
+            switch (kind) {
+                .directory => {
+                    if (!w.recursive) {
+                        continue;
+                    }
+                    const result = dir.subdirs.getOrPut(alloc, name) catch continue;
+                    if (!result.found_existing) {
+                        result.key_ptr.* = alloc.dupe(u8, name) catch {
+                            dir.subdirs.removeByPtr(result.key_ptr);
+                            continue;
+                        };
+                    }
+                    result.value_ptr.* = mark;
+                    const path = join(dir.path, name) orelse continue;
+                    stack.append(alloc, path) catch alloc.free(path);
+                },
+                .file => {
+                    const audio = scan.has_audio_extension(name) or
+                        (std.mem.indexOfScalar(u8, name, '.') == null and scan.has_audio_magic(fd, name_z));
+                    if (audio) {
+                        update_file(w, dir, fd, name_z, name, mark);
+                    }
+                },
+                .other => {},
+            }
+        }
+    }
+    // everything the listing did not see is gone.
+    var gone: std.ArrayList([]const u8) = .empty;
+    defer gone.deinit(alloc);
+    var files = dir.files.iterator();
+    while (files.next()) |kv| {
+        if (kv.value_ptr.mark != mark) {
+            gone.append(alloc, kv.key_ptr.*) catch return;
+        }
+    }
+    for (gone.items) |name| {
+        remove_file(w, dir, name);
+    }
+    gone.clearRetainingCapacity();
+    var subdirs = dir.subdirs.iterator();
+    while (subdirs.next()) |kv| {
+        if (kv.value_ptr.* != mark) {
+            gone.append(alloc, kv.key_ptr.*) catch return;
+        }
+    }
+    for (gone.items) |name| {
+        if (join(dir.path, name)) |path| {
+            remove_dir(w, path);
+            alloc.free(path);
+        }
+        const kv = dir.subdirs.fetchRemove(name) orelse continue;
+        alloc.free(kv.key);
+    }
+}
+
+/// Bring a directory tree in line with the disk.
+/// Directories whose mtime did not change keep their files, new ones and
+/// changed ones are listed again.
+fn sync_tree(w: *Watcher, root: []const u8) void {
+    var stack: std.ArrayList([:0]u8) = .empty;
+    defer {
+        for (stack.items) |path| {
+            alloc.free(path);
+        }
+        stack.deinit(alloc);
+    }
+    // symlinks may lead back up the tree, visit every directory once.
+    var visited: std.AutoHashMapUnmanaged(scan.FileId, void) = .empty;
+    defer visited.deinit(alloc);
+    const first = alloc.dupeZ(u8, root) catch return;
+    stack.append(alloc, first) catch {
+        alloc.free(first);
+        return;
+    };
+    while (stack.pop()) |path| {
+        defer alloc.free(path);
+        const fd = posix.openZ(path, .{ .DIRECTORY = true, .CLOEXEC = true }, 0) catch {
+            remove_dir(w, path);
+            continue;
+        };
+        defer posix.close(fd);
+        const stat = scan.stat_entry(fd, "") orelse continue;
+        const seen = visited.getOrPut(alloc, stat.id) catch continue;
+        const owner = w.ids.get(stat.id);
+        if (seen.found_existing or (owner != null and !std.mem.eql(u8, owner.?.path, path))) {
+            // another path of a directory already in the library.
+            if (w.dirs.contains(path)) {
+                remove_dir(w, path);
+            }
+            continue;
+        }
+        var dir = w.dirs.get(path);
+        const known = dir != null;
+        if (dir == null) {
+            dir = add_dir(w, path);
+        }
+        const d = dir orelse continue;
+        if (owner == null) {
+            // a new directory, or another one moved to the path.
+            if (d.id) |id| {
+                if (w.ids.get(id) == d) {
+                    _ = w.ids.remove(id);
+                }
+            }
+            w.ids.put(alloc, stat.id, d) catch {};
+            d.id = stat.id;
+        }
+        d.generation = w.generation;
+        // watch before listing, so nothing added in between is missed.
+        if (d.wd < 0) {
+            watch_dir(w, d);
+        }
+        if (known and d.mtime_sec == stat.mtime_sec and d.mtime_nsec == stat.mtime_nsec) {
+            var subdirs = d.subdirs.keyIterator();
+            while (subdirs.next()) |name| {
+                const child = join(d.path, name.*) orelse continue;
+                stack.append(alloc, child) catch alloc.free(child);
+            }
+            continue;
+        }
+        d.mtime_sec = stat.mtime_sec;
+        d.mtime_nsec = stat.mtime_nsec;
+        read_listing(w, d, fd, &stack);
+        mark_dirty(w);
+    }
+}
+
+/// Resync the whole library, after a queue overflow dropped events.
+fn resync(w: *Watcher) void {
+    w.generation +%= 1;
+    sync_tree(w, w.root);
+    // directories the walk did not reach are gone.
+    var doomed: std.ArrayList([]const u8) = .empty;
+    defer {
+        for (doomed.items) |path| {
+            alloc.free(path);
+        }
+        doomed.deinit(alloc);
+    }
+    var it = w.dirs.valueIterator();
+    while (it.next()) |dir| {
+        if (dir.*.generation != w.generation) {
+            const path = alloc.dupe(u8, dir.*.path) catch continue;
+            doomed.append(alloc, path) catch alloc.free(path);
+        }
+    }
+    for (doomed.items) |path| {
+        remove_dir(w, path);
+    }
+}
+
+/// Load the library from the index it was started with.
+fn load(w: *Watcher) void {
+    var idx = w.initial orelse return;
+    defer {
+        idx.close();
+        w.initial = null;
+    }
+    for (idx.dirs) |*record| {
+        const dir = add_dir(w, idx.str(record.path)) orelse continue;
+        dir.mtime_sec = record.mtime_sec;
+        dir.mtime_nsec = record.mtime_nsec;
+        for (idx.files_of(record)) |*file| {
+            const name = alloc.dupe(u8, file.name(&idx)) catch continue;
+            dir.files.put(alloc, name, .{
+                .size = file.size,
+                .mtime_sec = file.mtime_sec,
+                .mtime_nsec = file.mtime_nsec,
+                .info = .{
+                    .format = std.meta.intToEnum(tags.Format, file.format) catch .unknown,
+                    .duration_ms = file.duration_ms,
+                    .title = dupe_str(idx.str(file.title)),
+                    .artist = dupe_str(idx.str(file.artist)),
+                    .album = dupe_str(idx.str(file.album)),
+                },
+            }) catch alloc.free(name);
+        }
+        for (idx.children_of(record)) |*child| {
+            const child_path = idx.str(child.path);
+            const slash = std.mem.lastIndexOfScalar(u8, child_path, '/') orelse continue;
+            const name = alloc.dupe(u8, child_path[slash + 1 ..]) catch continue;
+            dir.subdirs.put(alloc, name, 0) catch alloc.free(name);
+        }
+    }
+}
+
+/// Write the library as the new index.
+fn write_index(w: *Watcher) void {
+    var writer = index.Writer.init(alloc);
+    defer writer.deinit();
+    var queue: std.ArrayList(*DirState) = .empty;
+    defer queue.deinit(alloc);
+    var names: std.ArrayList([]const u8) = .empty;
+    defer names.deinit(alloc);
+    const root = w.dirs.get(w.root) orelse return;
+    queue.append(alloc, root) catch return;
+    // breadth first, so the children of every directory are contiguous.
+    var i: usize = 0;
+    while (i < queue.items.len) : (i += 1) {
+        const dir = queue.items[i];
+        names.clearRetainingCapacity();
+        var subdirs = dir.subdirs.keyIterator();
+        while (subdirs.next()) |name| {
+            names.append(alloc, name.*) catch return;
+        }
+        std.mem.sort([]const u8, names.items, {}, name_less);
+        const first_child = queue.items.len;
+        for (names.items) |name| {
+            const path = join(dir.path, name) orelse return;
+            defer alloc.free(path);
+            const child = w.dirs.get(path) orelse continue;
+            queue.append(alloc, child) catch return;
+        }
+        const child_count = queue.items.len - first_child;
+
+        names.clearRetainingCapacity();
+        var files = dir.files.keyIterator();
+        while (files.next()) |name| {
+            names.append(alloc, name.*) catch return;
+        }
+        std.mem.sort([]const u8, names.items, {}, name_less);
+        writer.dirs.append(alloc, .{
+            .mtime_sec = dir.mtime_sec,
+            .mtime_nsec = dir.mtime_nsec,
+            .path = writer.add_str(dir.path) catch return,
+            .first_child = @intCast(first_child),
+            .child_count = @intCast(child_count),
+            .first_file = @intCast(writer.files.items.len),
+            .file_count = @intCast(names.items.len),
+        }) catch return;
+        for (names.items) |name| {
+            const file = dir.files.get(name).?;
+            const path = join(dir.path, name) orelse return;
+            defer alloc.free(path);
+            writer.add_file(path, path.len - name.len, file.size, file.mtime_sec, file.mtime_nsec, file.info) catch return;
+        }
+    }
+    var path_buf: [index.path_max]u8 = undefined;
+    const path = index.index_path(&path_buf, w.root, w.recursive, true) orelse return;
+    writer.write(path, w.root, w.recursive) catch return;
+}
+
+fn name_less(_: void, a: []const u8, b: []const u8) bool {
+    return std.mem.lessThan(u8, a, b);
+}
+
+/// Apply one inotify event to the library.
+fn handle_event(w: *Watcher, wd: i32, mask: u32, name: []const u8) void {
+    if (mask & linux.IN.Q_OVERFLOW != 0) {
+        resync(w);
+        return;
+    }
+    const dir = w.wds.get(wd) orelse return;
+    if (mask & linux.IN.IGNORED != 0) {
+        _ = w.wds.remove(wd);
+        if (dir.wd == wd) {
+            dir.wd = -1;
+        }
+        return;
+    }
+    if (name.len == 0) {
+        // sub directories are handled through their parent's events, only
+        // the root has nobody watching it.
+        if (mask & (linux.IN.DELETE_SELF | linux.IN.MOVE_SELF) != 0 and std.mem.eql(u8, dir.path, w.root)) {
+            remove_dir(w, w.root);
+        }
+        return;
+    }
+    const path = join(dir.path, name) orelse return;
+    defer alloc.free(path);
+    if (mask & linux.IN.ISDIR != 0) {
+        if (!w.recursive) {
+            return;
+        }
+        if (mask & (linux.IN.CREATE | linux.IN.MOVED_TO) != 0) {
+            const result = dir.subdirs.getOrPut(alloc, name) catch return;
+            if (!result.found_existing) {
+                result.key_ptr.* = alloc.dupe(u8, name) catch {
+                    dir.subdirs.removeByPtr(result.key_ptr);
+                    return;
+                };
+            }
+            // lists the new tree, files created before its watch included.
+            sync_tree(w, path);
+        } else if (mask & (linux.IN.DELETE | linux.IN.MOVED_FROM) != 0) {
+            remove_dir(w, path);
+            if (dir.subdirs.fetchRemove(name)) |kv| {
+                alloc.free(kv.key);
+            }
+        }
+    } else if (mask & (linux.IN.CLOSE_WRITE | linux.IN.MOVED_TO) != 0) {
+        // a rename within the library is a remove and an add.
+        const audio = scan.has_audio_extension(name) or
+            (std.mem.indexOfScalar(u8, name, '.') == null and scan.has_audio_magic(posix.AT.FDCWD, path));
+        if (audio) {
+            update_file(w, dir, posix.AT.FDCWD, path, name, 0);
+        }
+    } else if (mask & (linux.IN.DELETE | linux.IN.MOVED_FROM) != 0) {
+        remove_file(w, dir, name);
+    }
+    // the directory changed, keep its mtime in line so scans skip it.
+    if (scan.stat_entry(posix.AT.FDCWD, dir.path)) |stat| {
+        dir.mtime_sec = stat.mtime_sec;
+        dir.mtime_nsec = stat.mtime_nsec;
+        mark_dirty(w);
+    }
+}
+
+/// Read and apply every queued inotify event.
+fn read_events(w: *Watcher) void {
+    var buf: [events_size]u8 align(@alignOf(linux.inotify_event)) = undefined;
+    while (true) {
+        const len = posix.read(w.inotify_fd, &buf) catch return;
+        if (len == 0) {
+            return;
+        }
+        var offset: usize = 0;
+        while (offset + @sizeOf(linux.inotify_event) <= len) {
+            const event: *const linux.inotify_event = @ptrCast(@alignCast(&buf[offset]));
+            const name_start = offset + @sizeOf(linux.inotify_event);
+            offset = name_start + event.len;
+            if (offset > len) {
+                return;
+            }
+            const name = std.mem.sliceTo(buf[name_start..offset], 0);
+            handle_event(w, event.wd, event.mask, name);
+        }
+    }
+}
+
+/// Body of the watcher thread.
+fn run(w: *Watcher) void {
+    load(w);
+    // catch up with what changed since the index was written.
+    resync(w);
+    var fds = [2]posix.pollfd{
+        .{ .fd = w.inotify_fd, .events = posix.POLL.IN, .revents = 0 },
+        .{ .fd = w.stop_fd, .events = posix.POLL.IN, .revents = 0 },
+    };
+    while (true) {
+        w.lock.lock();
+        const changed = w.pending.items.len > 0;
+        w.lock.unlock();
+        if (changed) {
+            signal();
+        }
+        var timeout: i32 = -1;
+        if (w.dirty_since) |since| {
+            const elapsed = std.time.milliTimestamp() - since;
+            timeout = @intCast(std.math.clamp(flush_delay_ms - elapsed, 0, flush_delay_ms));
+        }
+        const ready = posix.poll(&fds, timeout) catch break;
+        if (fds[1].revents != 0) {
+            break;
+        }
+        if (ready == 0) {
+            write_index(w);
+            w.dirty_since = null;
+            continue;
+        }
+        read_events(w);
+    }
+    if (w.dirty_since != null) {
+        write_index(w);
+    }
+}
+
+/// Stop the running watcher and free it.
+fn stop_watcher() void {
+    const w = current orelse return;
+    if (w.thread) |thread| {
+        const one: u64 = 1;
+        _ = posix.write(w.stop_fd, std.mem.asBytes(&one)) catch {};
+        thread.join();
+    }
+    if (w.initial) |*idx| {
+        idx.close();
+    }
+    var it = w.dirs.valueIterator();
+    while (it.next()) |dir| {
+        free_dir(dir.*);
+    }
+    w.dirs.deinit(alloc);
+    w.wds.deinit(alloc);
+    w.ids.deinit(alloc);
+    w.pending.deinit(alloc);
+    posix.close(w.inotify_fd);
+    posix.close(w.stop_fd);
+    alloc.free(w.root);
+    alloc.destroy(w);
+    current = null;
+}
+
+/// Start keeping the library index of a directory current.
+/// Stops the running watcher, if any.
+///
+/// @param root The directory, it needs a library index from a finished scan.
+/// @param recursive 1 to watch sub directories too.
+/// @return 0 for success, -1 if the directory has no index, Less than -1 for
+///  other failures.
+pub export fn watch_start(root: [*:0]const u8, recursive: c_int) c_int {
+    stop_watcher();
+    const path = scan.normalize_root(root);
+    var path_buf: [index.path_max]u8 = undefined;
+    const index_file = index.index_path(&path_buf, path, recursive != 0, false) orelse return -1;
+    var initial = index.Index.open(index_file, path, recursive != 0) orelse return -1;
+    if (event_fd == null) {
+        event_fd = posix.eventfd(0, linux.EFD.NONBLOCK | linux.EFD.CLOEXEC) catch {
+            initial.close();
+            return -2;
+        };
+    }
+    const inotify_fd = posix.inotify_init1(linux.IN.NONBLOCK | linux.IN.CLOEXEC) catch {
+        initial.close();
+        return -3;
+    };
+    const stop_fd = posix.eventfd(0, linux.EFD.CLOEXEC) catch {
+        posix.close(inotify_fd);
+        initial.close();
+        return -2;
+    };
+    const w = alloc.create(Watcher) catch {
+        posix.close(stop_fd);
+        posix.close(inotify_fd);
+        initial.close();
+        return -4;
+    };
+    const owned_root = alloc.dupeZ(u8, path) catch {
+        alloc.destroy(w);
+        posix.close(stop_fd);
+        posix.close(inotify_fd);
+        initial.close();
+        return -4;
+    };
+    w.* = .{
+        .root = owned_root,
+        .recursive = recursive != 0,
+        .inotify_fd = inotify_fd,
+        .stop_fd = stop_fd,
+        .initial = initial,
+    };
+    current = w;
+    w.thread = std.Thread.spawn(.{}, run, .{w}) catch {
+        stop_watcher();
+        return -5;
+    };
+    return 0;
+}
+
+/// Get the eventfd that becomes readable when files of the library changed.
+///
+/// @return The file descriptor, -1 if no watcher ever started.
+pub export fn watch_fd() c_int {
+    return event_fd orelse -1;
+}
+
+/// Take the row changes since the last call.
+/// Clears the eventfd once everything was taken.
+///
+/// @return Changes one per line, in the order they happened. Added or
+///  changed files are "+path\ttitle\tartist\talbum\tduration_ms", removed files
+///  "-path". Valid until the next call. Null if there are none.
+pub export fn watch_take() ?[*:0]const u8 {
+    const w = current orelse return null;
+    w.lock.lock();
+    defer w.lock.unlock();
+    if (w.pending.items.len == 0) {
+        if (event_fd) |fd| {
+            var count: u64 = 0;
+            _ = posix.read(fd, std.mem.asBytes(&count)) catch {};
+        }
+        return null;
+    }
+    // swap the buffers, the watcher keeps appending to the other one.
+    std.mem.swap(std.ArrayList(u8), &taken, &w.pending);
+    w.pending.clearRetainingCapacity();
+    taken.append(alloc, 0) catch return null;
+    return @ptrCast(taken.items.ptr);
+}
+
+/// Stop the watcher, writing the index if it has unsaved changes.
+pub export fn watch_stop() void {
+    stop_watcher();
+}
+
+test "a path is joined with one separator" {
+    const a = join("/music", "a.mp3") orelse return error.TestUnexpectedResult;
+    defer alloc.free(a);
+    try std.testing.expectEqualStrings("/music/a.mp3", a);
+    const b = join("/", "b.mp3") orelse return error.TestUnexpectedResult;
+    defer alloc.free(b);
+    try std.testing.expectEqualStrings("/b.mp3", b);
+}